@@ -3,7 +3,52 @@
 #include <string.h>
 #include <stdio.h>
 #include "devices/ide.h"
+#include "threads/cpu.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* Number of buckets in the queue depth and latency histograms.
+   Bucket I counts values in [2**I, 2**(I+1)), except that the
+   first bucket also counts 0 and the last bucket also counts
+   everything larger. */
+#define HISTOGRAM_BUCKETS 12
+
+/* Most sectors that merged requests may cover together. */
+#define MERGE_MAX_SECTORS 256
+
+/* State of a block request. */
+enum request_state
+  {
+    REQUEST_QUEUED,             /* Waiting in the device queue. */
+    REQUEST_DISPATCH,           /* Leader chosen to issue its group. */
+    REQUEST_DONE                /* Completed. */
+  };
+
+/* A request to transfer consecutive sectors, owned by the thread
+   that is waiting for it to complete.
+
+   Adjacent requests in the same direction are merged into a
+   group, which is issued to the driver as one transfer.  The
+   group's first request to be queued is its leader: only the
+   leader is in the device queue, and it records the sectors that
+   the whole group covers. */
+struct block_request
+  {
+    struct list_elem queue_elem;        /* Leader: in block's queue. */
+    struct list group;                  /* Leader: members, by sector. */
+    struct list_elem group_elem;        /* Element in leader's group. */
+    block_sector_t group_sector;        /* Leader: group's first sector. */
+    size_t group_cnt;                   /* Leader: sectors in group. */
+
+    block_sector_t sector;              /* First sector. */
+    size_t cnt;                         /* Number of sectors. */
+    void **buffers;                     /* One buffer per sector. */
+    bool write;                         /* Write, not read? */
+
+    enum request_state state;           /* Protected by block's lock. */
+    struct semaphore sema;              /* Up'd on completion or dispatch. */
+    uint64_t start;                     /* rdtsc() at submission. */
+  };
 
 /* A block device. */
 struct block
@@ -19,6 +64,22 @@ struct block
 
     unsigned long long read_cnt;        /* Number of sectors read. */
     unsigned long long write_cnt;       /* Number of sectors written. */
+
+    /* Request queue.  Requests wait here, sorted by sector, while
+       another request is in progress, and are issued in C-LOOK
+       order: ascending from the last sector transferred, then
+       back to the lowest. */
+    struct lock queue_lock;             /* Protects the members below. */
+    struct list queue;                  /* Queued group leaders. */
+    bool busy;                          /* Request in progress? */
+    block_sector_t head;                /* Sector after last transfer. */
+    unsigned pending;                   /* Requests not yet complete. */
+    void *dispatch_buffers[MERGE_MAX_SECTORS];  /* For busy request. */
+
+    unsigned long long request_cnt;     /* Number of requests. */
+    unsigned long long merge_cnt;       /* Number merged into another. */
+    unsigned long long depth_hist[HISTOGRAM_BUCKETS];   /* Queue depth. */
+    unsigned long long latency_hist[HISTOGRAM_BUCKETS]; /* In kcycles. */
   };
 
 /* List of all block devices. */
@@ -28,6 +89,8 @@ static struct list all_blocks = LIST_INITIALIZER (all_blocks);
 static struct block *block_by_role[BLOCK_ROLE_CNT];
 
 static struct block *list_elem_to_block (struct list_elem *);
+static void submit_request (struct block *, block_sector_t, size_t cnt,
+                            void *buffers[], bool write);
 
 /* Returns a human-readable name for the given block device
    TYPE. */
@@ -121,8 +184,7 @@ void
 block_read (struct block *block, block_sector_t sector, void *buffer)
 {
   check_sector (block, sector);
-  block->ops->read (block->aux, sector, buffer);
-  block->read_cnt++;
+  submit_request (block, sector, 1, &buffer, false);
 }
 
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -133,10 +195,264 @@ block_read (struct block *block, block_sector_t sector, void *buffer)
 void
 block_write (struct block *block, block_sector_t sector, const void *buffer)
 {
+  void *buffers[1];
+
   check_sector (block, sector);
   ASSERT (block->type != BLOCK_FOREIGN);
-  block->ops->write (block->aux, sector, buffer);
-  block->write_cnt++;
+  buffers[0] = (void *) buffer;
+  submit_request (block, sector, 1, buffers, true);
+}
+
+/* Reads the CNT consecutive sectors starting at SECTOR from BLOCK
+   into BUFFERS[0] through BUFFERS[CNT - 1], each of which must
+   have room for BLOCK_SECTOR_SIZE bytes.  Drivers that support it
+   transfer all of the sectors with a single command.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_read_multiple (struct block *block, block_sector_t sector, size_t cnt,
+                     void *buffers[])
+{
+  if (cnt == 0)
+    return;
+  check_sector (block, sector);
+  check_sector (block, sector + cnt - 1);
+  submit_request (block, sector, cnt, buffers, false);
+}
+
+/* Writes the CNT consecutive sectors starting at SECTOR to BLOCK
+   from BUFFERS[0] through BUFFERS[CNT - 1], each of which must
+   contain BLOCK_SECTOR_SIZE bytes.  Returns after the block
+   device has acknowledged receiving the data.  Drivers that
+   support it transfer all of the sectors with a single command.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_write_multiple (struct block *block, block_sector_t sector, size_t cnt,
+                      const void *buffers[])
+{
+  if (cnt == 0)
+    return;
+  check_sector (block, sector);
+  check_sector (block, sector + cnt - 1);
+  ASSERT (block->type != BLOCK_FOREIGN);
+
+  /* The buffers are only read from, but requests keep read and
+     write buffers alike. */
+  submit_request (block, sector, cnt, (void **) buffers, true);
+}
+
+/* Returns the histogram bucket for VALUE. */
+static int
+histogram_bucket (uint64_t value)
+{
+  int bucket = 0;
+
+  while (value > 1 && bucket < HISTOGRAM_BUCKETS - 1)
+    {
+      value >>= 1;
+      bucket++;
+    }
+  return bucket;
+}
+
+/* Tries to add REQ to a group already in BLOCK's queue that ends
+   just before or starts just after it.  Returns true if
+   successful.  BLOCK's queue_lock must be held. */
+static bool
+merge_request (struct block *block, struct block_request *req)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&block->queue); e != list_end (&block->queue);
+       e = list_next (e))
+    {
+      struct block_request *leader = list_entry (e, struct block_request,
+                                                 queue_elem);
+      if (leader->write != req->write
+          || leader->group_cnt + req->cnt > MERGE_MAX_SECTORS)
+        continue;
+
+      if (leader->group_sector + leader->group_cnt == req->sector)
+        list_push_back (&leader->group, &req->group_elem);
+      else if (req->sector + req->cnt == leader->group_sector)
+        {
+          list_push_front (&leader->group, &req->group_elem);
+          leader->group_sector = req->sector;
+        }
+      else
+        continue;
+      leader->group_cnt += req->cnt;
+      block->merge_cnt++;
+      return true;
+    }
+  return false;
+}
+
+/* Returns true if request A's group starts at a lower sector
+   than request B's. */
+static bool
+group_less (const struct list_elem *a_, const struct list_elem *b_,
+            void *aux UNUSED)
+{
+  const struct block_request *a = list_entry (a_, struct block_request,
+                                              queue_elem);
+  const struct block_request *b = list_entry (b_, struct block_request,
+                                              queue_elem);
+
+  return a->group_sector < b->group_sector;
+}
+
+/* Removes and returns the next group leader to issue from
+   BLOCK's queue in C-LOOK order, or a null pointer if the queue
+   is empty.  BLOCK's queue_lock must be held. */
+static struct block_request *
+next_request (struct block *block)
+{
+  struct list_elem *e;
+
+  if (list_empty (&block->queue))
+    return NULL;
+  for (e = list_begin (&block->queue); e != list_end (&block->queue);
+       e = list_next (e))
+    if (list_entry (e, struct block_request, queue_elem)->group_sector
+        >= block->head)
+      break;
+  if (e == list_end (&block->queue))
+    e = list_begin (&block->queue);
+  list_remove (e);
+  return list_entry (e, struct block_request, queue_elem);
+}
+
+/* Issues LEADER's group of requests to BLOCK's driver, then
+   wakes the group's other members and hands the device to the
+   next group in the queue.  Must be called by LEADER's owner,
+   without BLOCK's queue_lock held, while BLOCK is busy. */
+static void
+dispatch_request (struct block *block, struct block_request *leader)
+{
+  struct block_request *next;
+  struct list_elem *e;
+  void **buffers;
+  size_t cnt = 0;
+  size_t i;
+  uint64_t now;
+
+  /* Gather the group's buffers in sector order. */
+  if (list_size (&leader->group) == 1)
+    buffers = leader->buffers;
+  else
+    {
+      buffers = block->dispatch_buffers;
+      for (e = list_begin (&leader->group); e != list_end (&leader->group);
+           e = list_next (e))
+        {
+          struct block_request *req = list_entry (e, struct block_request,
+                                                  group_elem);
+          memcpy (buffers + cnt, req->buffers, req->cnt * sizeof *buffers);
+          cnt += req->cnt;
+        }
+    }
+
+  cnt = leader->group_cnt;
+  if (leader->write)
+    {
+      if (block->ops->write_multiple != NULL)
+        block->ops->write_multiple (block->aux, leader->group_sector, cnt,
+                                    (const void **) buffers);
+      else
+        for (i = 0; i < cnt; i++)
+          block->ops->write (block->aux, leader->group_sector + i,
+                             buffers[i]);
+    }
+  else
+    {
+      if (block->ops->read_multiple != NULL)
+        block->ops->read_multiple (block->aux, leader->group_sector, cnt,
+                                   buffers);
+      else
+        for (i = 0; i < cnt; i++)
+          block->ops->read (block->aux, leader->group_sector + i,
+                            buffers[i]);
+    }
+  now = rdtsc ();
+
+  lock_acquire (&block->queue_lock);
+  if (leader->write)
+    block->write_cnt += cnt;
+  else
+    block->read_cnt += cnt;
+  block->head = leader->group_sector + cnt;
+
+  /* Complete the group.  A member's request may disappear as
+     soon as its semaphore is up'd, so advance first. */
+  for (e = list_begin (&leader->group); e != list_end (&leader->group); )
+    {
+      struct block_request *req = list_entry (e, struct block_request,
+                                              group_elem);
+      e = list_next (e);
+      block->latency_hist[histogram_bucket ((now - req->start) / 1024)]++;
+      block->pending--;
+      req->state = REQUEST_DONE;
+      if (req != leader)
+        sema_up (&req->sema);
+    }
+
+  /* Hand the device to the next group, if any. */
+  next = next_request (block);
+  if (next != NULL)
+    {
+      next->state = REQUEST_DISPATCH;
+      sema_up (&next->sema);
+    }
+  else
+    block->busy = false;
+  lock_release (&block->queue_lock);
+}
+
+/* Transfers the CNT sectors starting at SECTOR between BLOCK and
+   BUFFERS through BLOCK's request queue, writing them if WRITE is
+   true, and returns once the transfer is complete.
+
+   There is no thread per device.  If BLOCK is idle, the calling
+   thread issues its own request; otherwise it queues the request
+   and sleeps until the request either completes as part of
+   another group or is chosen as the next group to issue. */
+static void
+submit_request (struct block *block, block_sector_t sector, size_t cnt,
+                void *buffers[], bool write)
+{
+  struct block_request req;
+
+  req.sector = req.group_sector = sector;
+  req.cnt = req.group_cnt = cnt;
+  req.buffers = buffers;
+  req.write = write;
+  req.state = REQUEST_QUEUED;
+  sema_init (&req.sema, 0);
+  list_init (&req.group);
+  req.start = rdtsc ();
+
+  lock_acquire (&block->queue_lock);
+  block->request_cnt++;
+  block->depth_hist[histogram_bucket (++block->pending)]++;
+  if (!block->busy)
+    {
+      block->busy = true;
+      list_push_back (&req.group, &req.group_elem);
+      req.state = REQUEST_DISPATCH;
+    }
+  else if (!merge_request (block, &req))
+    {
+      list_push_back (&req.group, &req.group_elem);
+      list_insert_ordered (&block->queue, &req.queue_elem, group_less, NULL);
+    }
+  lock_release (&block->queue_lock);
+
+  if (req.state != REQUEST_DISPATCH)
+    sema_down (&req.sema);
+  if (req.state == REQUEST_DISPATCH)
+    dispatch_request (block, &req);
 }
 
 /* Returns the number of sectors in BLOCK. */
@@ -160,6 +476,27 @@ block_type (struct block *block)
   return block->type;
 }
 
+/* Prints histogram HIST for the block device named NAME,
+   labelled LABEL, omitting empty buckets. */
+static void
+print_histogram (const char *name, const char *label,
+                 const unsigned long long hist[HISTOGRAM_BUCKETS])
+{
+  int i;
+
+  printf ("%s: %s", name, label);
+  for (i = 0; i < HISTOGRAM_BUCKETS; i++)
+    if (hist[i] != 0)
+      {
+        if (i == HISTOGRAM_BUCKETS - 1)
+          printf (" %u+:%llu", 1u << i, hist[i]);
+        else
+          printf (" %u-%u:%llu", i > 0 ? 1u << i : 0, (2u << i) - 1,
+                  hist[i]);
+      }
+  printf ("\n");
+}
+
 /* Prints statistics for each block device used for a Pintos role. */
 void
 block_print_stats (void)
@@ -174,6 +511,11 @@ block_print_stats (void)
           printf ("%s (%s): %llu reads, %llu writes\n",
                   block->name, block_type_name (block->type),
                   block->read_cnt, block->write_cnt);
+          printf ("%s: %llu requests, %llu merged\n",
+                  block->name, block->request_cnt, block->merge_cnt);
+          print_histogram (block->name, "queue depth", block->depth_hist);
+          print_histogram (block->name, "latency (kcycles)",
+                           block->latency_hist);
         }
     }
 }
@@ -200,6 +542,14 @@ block_register (const char *name, enum block_type type,
   block->aux = aux;
   block->read_cnt = 0;
   block->write_cnt = 0;
+  lock_init (&block->queue_lock);
+  list_init (&block->queue);
+  block->busy = false;
+  block->head = 0;
+  block->pending = 0;
+  block->request_cnt = block->merge_cnt = 0;
+  memset (block->depth_hist, 0, sizeof block->depth_hist);
+  memset (block->latency_hist, 0, sizeof block->latency_hist);
 
   printf ("%s: %'"PRDSNu" sectors (", block->name, block->size);
   print_human_readable_size ((uint64_t) block->size * BLOCK_SECTOR_SIZE);
@@ -3,15 +3,21 @@
 #include <debug.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 #include "devices/block.h"
 #include "devices/partition.h"
 #include "devices/timer.h"
+#include "threads/cpu.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
-   controller.  It attempts to comply to [ATA-3]. */
+   controller.  It attempts to comply to [ATA-3].  If a PCI
+   bus-master IDE controller, such as the PIIX that QEMU emulates,
+   is found, transfers use DMA; otherwise they use PIO. */
 
 /* ATA command block port addresses. */
 #define reg_data(CHANNEL) ((CHANNEL)->reg_base + 0)     /* Data. */
@@ -34,6 +40,7 @@
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -43,12 +50,34 @@
 #define DEV_LBA 0x40            /* Linear based addressing. */
 #define DEV_DEV 0x10            /* Select device: 0=master, 1=slave. */
 
+/* Bus-master IDE register port addresses, relative to the
+   channel's bm_base. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0)  /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)   /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)     /* PRD table. */
+
+/* Bus-master Command Register bits. */
+#define BM_CMD_START 0x01       /* Start transfer. */
+#define BM_CMD_READ 0x08        /* Transfer from disk to memory. */
+
+/* Bus-master Status Register bits. */
+#define BM_STA_ERR 0x02         /* Error. */
+#define BM_STA_INTR 0x04        /* Interrupt. */
+
 /* Commands.
    Many more are defined but this is the small subset that we
    use. */
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_MULTIPLE 0xc4          /* READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE 0xc5         /* WRITE MULTIPLE. */
+#define CMD_SET_MULTIPLE_MODE 0xc6      /* SET MULTIPLE MODE. */
+#define CMD_READ_DMA 0xc8               /* READ DMA. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA. */
+
+/* Most sectors that one READ or WRITE command can transfer. */
+#define MAX_CMD_SECTORS 256
 
 /* An ATA device. */
 struct ata_disk
@@ -57,8 +86,24 @@ struct ata_disk
     struct channel *channel;    /* Channel that disk is attached to. */
     int dev_no;                 /* Device 0 or 1 for master or slave. */
     bool is_ata;                /* Is device an ATA disk? */
+    int mult_cnt;               /* Sectors per interrupt, 1 unless READ
+                                   and WRITE MULTIPLE are enabled. */
+    bool dma;                   /* Transfer by DMA? */
   };
 
+/* A Physical Region Descriptor: one entry in the table of
+   physically contiguous memory regions that a bus master moves
+   data to or from.  A region may not cross a 64 kB boundary. */
+struct prd
+  {
+    uint32_t addr;              /* Physical address. */
+    uint16_t size;              /* Size in bytes, 0 meaning 64 kB. */
+    uint16_t flags;             /* PRD_EOT if last entry in table. */
+  };
+
+#define PRD_EOT 0x8000          /* End of table. */
+#define PRD_CNT (PGSIZE / sizeof (struct prd))
+
 /* An ATA channel (aka controller).
    Each channel can control up to two disks. */
 struct channel
@@ -72,6 +117,13 @@ struct channel
                                    any interrupt would be spurious. */
     struct semaphore completion_wait;   /* Up'd by interrupt handler. */
 
+    uint16_t bm_base;           /* Bus-master registers, 0 if none. */
+    struct prd *prdt;           /* PRD table, one page. */
+
+    uint64_t read_cycles;       /* CPU cycles spent reading. */
+    uint64_t read_sectors;      /* Number of sectors read. */
+    uint64_t wait_cycles;       /* Cycles spent waiting for interrupts. */
+
     struct ata_disk devices[2];     /* The devices on this channel. */
   };
 
@@ -81,11 +133,13 @@ static struct channel channels[CHANNEL_CNT];
 
 static struct block_operations ide_operations;
 
+static uint16_t find_bus_master (void);
 static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
 
-static void select_sector (struct ata_disk *, block_sector_t);
+static void set_multiple_mode (struct ata_disk *, int mult_cnt);
+static void select_sector (struct ata_disk *, block_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
@@ -95,12 +149,14 @@ static bool wait_while_busy (const struct ata_disk *);
 static void select_device (const struct ata_disk *);
 static void select_device_wait (const struct ata_disk *);
 
+static void wait_for_interrupt (struct channel *);
 static void interrupt_handler (struct intr_frame *);
 
 /* Initialize the disk subsystem and detect disks. */
 void
 ide_init (void)
 {
+  uint16_t bm_base = find_bus_master ();
   size_t chan_no;
 
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
@@ -126,6 +182,15 @@ ide_init (void)
       lock_init (&c->lock);
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
+      c->bm_base = 0;
+      c->prdt = NULL;
+      if (bm_base != 0)
+        {
+          c->prdt = palloc_get_page (0);
+          if (c->prdt != NULL)
+            c->bm_base = bm_base + chan_no * 8;
+        }
+      c->read_cycles = c->read_sectors = c->wait_cycles = 0;
 
       /* Initialize devices. */
       for (dev_no = 0; dev_no < 2; dev_no++)
@@ -136,6 +201,8 @@ ide_init (void)
           d->channel = c;
           d->dev_no = dev_no;
           d->is_ata = false;
+          d->mult_cnt = 1;
+          d->dma = false;
         }
 
       /* Register interrupt handler. */
@@ -155,6 +222,103 @@ ide_init (void)
     }
 }
 
+/* Returns CPU cycles spent in the IDE driver per megabyte read
+   from disk, not counting time spent waiting for the disk, or 0
+   if nothing has been read. */
+uint64_t
+ide_read_cycles_per_mb (void)
+{
+  uint64_t cycles = 0, sectors = 0;
+  size_t chan_no;
+
+  for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
+    {
+      cycles += channels[chan_no].read_cycles;
+      sectors += channels[chan_no].read_sectors;
+    }
+  return (sectors > 0
+          ? cycles * (1024 * 1024 / BLOCK_SECTOR_SIZE) / sectors
+          : 0);
+}
+
+/* PCI configuration space access, configuration mechanism #1.
+   IDE is the only Pintos driver that needs PCI, so this is
+   kept here rather than in a PCI layer of its own. */
+#define PCI_CONFIG_ADDR 0xcf8
+#define PCI_CONFIG_DATA 0xcfc
+
+/* Reads the 32-bit PCI configuration register REG of function
+   FUNC of device DEV on bus BUS. */
+static uint32_t
+pci_read_config (int bus, int dev, int func, int reg)
+{
+  outl (PCI_CONFIG_ADDR, (0x80000000 | (bus << 16) | (dev << 11)
+                          | (func << 8) | (reg & 0xfc)));
+  return inl (PCI_CONFIG_DATA);
+}
+
+/* Writes VALUE to PCI configuration register REG of function
+   FUNC of device DEV on bus BUS. */
+static void
+pci_write_config (int bus, int dev, int func, int reg, uint32_t value)
+{
+  outl (PCI_CONFIG_ADDR, (0x80000000 | (bus << 16) | (dev << 11)
+                          | (func << 8) | (reg & 0xfc)));
+  outl (PCI_CONFIG_DATA, value);
+}
+
+/* Looks for a bus-master capable PCI IDE controller that runs
+   both channels at the legacy port addresses this driver uses.
+   If one is found, enables bus mastering on it and returns the
+   I/O port base of its bus-master registers (BAR4).  Returns 0
+   if there is none.
+
+   A controller that decodes the legacy ports sits in the chipset
+   on bus 0, so only bus 0 is scanned.  Functions 1 through 7 are
+   probed only for devices that report several functions. */
+static uint16_t
+find_bus_master (void)
+{
+  int dev, func;
+
+  for (dev = 0; dev < 32; dev++)
+    {
+      int func_cnt;
+
+      if ((pci_read_config (0, dev, 0, 0x00) & 0xffff) == 0xffff)
+        continue;
+
+      /* Bit 7 of the header type marks a multi-function device. */
+      func_cnt = pci_read_config (0, dev, 0, 0x0c) & (0x80 << 16) ? 8 : 1;
+      for (func = 0; func < func_cnt; func++)
+        {
+          uint32_t class, bar4;
+          uint8_t prog_if;
+
+          if ((pci_read_config (0, dev, func, 0x00) & 0xffff) == 0xffff)
+            continue;
+
+          /* Mass storage controller, IDE, bus-master capable,
+             both channels in compatibility mode. */
+          class = pci_read_config (0, dev, func, 0x08);
+          prog_if = class >> 8;
+          if ((class >> 16) != 0x0101 || !(prog_if & 0x80)
+              || (prog_if & 0x05) != 0)
+            continue;
+
+          bar4 = pci_read_config (0, dev, func, 0x20);
+          if (!(bar4 & 1) || (bar4 & 0xfffc) == 0)
+            continue;
+
+          /* Enable I/O space and bus mastering. */
+          pci_write_config (0, dev, func, 0x04,
+                            pci_read_config (0, dev, func, 0x04) | 0x05);
+          return bar4 & 0xfffc;
+        }
+    }
+  return 0;
+}
+
 /* Disk detection and identification. */
 
 static char *descramble_ata_string (char *, int size);
@@ -273,7 +437,7 @@ identify_ata_device (struct ata_disk *d)
      into our buffer. */
   select_device_wait (d);
   issue_pio_command (c, CMD_IDENTIFY_DEVICE);
-  sema_down (&c->completion_wait);
+  wait_for_interrupt (c);
   if (!wait_while_busy (d))
     {
       d->is_ata = false;
@@ -303,6 +467,16 @@ identify_ata_device (struct ata_disk *d)
       return;
     }
 
+  /* Word 47 gives the most sectors the disk can transfer per
+     interrupt with READ and WRITE MULTIPLE. */
+  if ((uint8_t) id[47 * 2] > 1)
+    set_multiple_mode (d, (uint8_t) id[47 * 2]);
+
+  /* Bit 8 of word 49 says whether the disk supports DMA. */
+  d->dma = c->bm_base != 0 && (id[49 * 2 + 1] & 0x01) != 0;
+  if (d->dma)
+    strlcat (extra_info, ", DMA", sizeof extra_info);
+
   /* Register. */
   block = block_register (d->name, BLOCK_RAW, extra_info, capacity,
                           &ide_operations, d);
@@ -337,63 +511,261 @@ descramble_ata_string (char *string, int size)
   return string;
 }
 
-/* Reads sector SEC_NO from disk D into BUFFER, which must have
-   room for BLOCK_SECTOR_SIZE bytes.
+/* Enables READ and WRITE MULTIPLE on disk D with MULT_CNT
+   sectors per interrupt.  Leaves D's mult_cnt at 1 if the disk
+   rejects the setting. */
+static void
+set_multiple_mode (struct ata_disk *d, int mult_cnt)
+{
+  struct channel *c = d->channel;
+
+  select_device_wait (d);
+  outb (reg_nsect (c), mult_cnt);
+  issue_pio_command (c, CMD_SET_MULTIPLE_MODE);
+  wait_for_interrupt (c);
+  wait_while_busy (d);
+  if (!(inb (reg_status (c)) & STA_ERR))
+    d->mult_cnt = mult_cnt;
+}
+
+/* Fills channel C's PRD table to describe the CNT sector
+   buffers in BUFFERS, merging buffers that are adjacent in
+   physical memory.  Returns false if the buffers cannot be
+   described, because one is not word-aligned or the table would
+   overflow. */
+static bool
+build_prdt (struct channel *c, const void *buffers[], size_t cnt)
+{
+  struct prd *prd = NULL;
+  size_t prd_cnt = 0;
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    {
+      uintptr_t addr = vtop (buffers[i]);
+      size_t left = BLOCK_SECTOR_SIZE;
+
+      if (addr & 1)
+        return false;
+      while (left > 0)
+        {
+          /* Bytes up to the next 64 kB boundary. */
+          size_t size = 0x10000 - (addr & 0xffff);
+          if (size > left)
+            size = left;
+
+          if (prd != NULL && prd->addr + prd->size == addr
+              && ((prd->addr + prd->size) & 0xffff) != 0)
+            prd->size += size;
+          else
+            {
+              if (prd_cnt >= PRD_CNT)
+                return false;
+              prd = &c->prdt[prd_cnt++];
+              prd->addr = addr;
+              prd->size = size;
+              prd->flags = 0;
+            }
+          addr += size;
+          left -= size;
+        }
+    }
+  prd->flags = PRD_EOT;
+  return true;
+}
+
+/* Transfers the CNT (at most MAX_CMD_SECTORS) sectors starting
+   at SEC_NO between disk D and BUFFERS by DMA, reading from disk
+   if WRITE is false.  The caller must hold D's channel lock.
+   Returns false, without starting a transfer, if BUFFERS cannot
+   be used for DMA. */
+static bool
+dma_transfer (struct ata_disk *d, block_sector_t sec_no, size_t cnt,
+              const void *buffers[], bool write)
+{
+  struct channel *c = d->channel;
+  uint8_t status;
+
+  if (!build_prdt (c, buffers, cnt))
+    return false;
+
+  outl (reg_bm_prdt (c), vtop (c->prdt));
+  outb (reg_bm_command (c), write ? 0 : BM_CMD_READ);
+  outb (reg_bm_status (c), BM_STA_ERR | BM_STA_INTR);
+
+  select_sector (d, sec_no, cnt);
+  issue_pio_command (c, write ? CMD_WRITE_DMA : CMD_READ_DMA);
+  outb (reg_bm_command (c), (write ? 0 : BM_CMD_READ) | BM_CMD_START);
+  wait_for_interrupt (c);
+  outb (reg_bm_command (c), 0);
+
+  status = inb (reg_bm_status (c));
+  outb (reg_bm_status (c), BM_STA_ERR | BM_STA_INTR);
+  if ((status & BM_STA_ERR) || (inb (reg_alt_status (c)) & STA_ERR))
+    PANIC ("%s: DMA %s failed, sector=%"PRDSNu,
+           d->name, write ? "write" : "read", sec_no);
+  return true;
+}
+
+/* Reads the CNT (at most MAX_CMD_SECTORS) sectors starting at
+   SEC_NO from disk D into BUFFERS by PIO.  The disk interrupts
+   once per mult_cnt sectors.  The caller must hold D's channel
+   lock. */
+static void
+pio_read (struct ata_disk *d, block_sector_t sec_no, size_t cnt,
+          void *buffers[])
+{
+  struct channel *c = d->channel;
+  size_t i;
+
+  select_sector (d, sec_no, cnt);
+  issue_pio_command (c, (d->mult_cnt > 1 ? CMD_READ_MULTIPLE
+                         : CMD_READ_SECTOR_RETRY));
+  for (i = 0; i < cnt; i++)
+    {
+      if (i % d->mult_cnt == 0)
+        {
+          wait_for_interrupt (c);
+          if (!wait_while_busy (d))
+            PANIC ("%s: disk read failed, sector=%"PRDSNu,
+                   d->name, sec_no + i);
+        }
+      input_sector (c, buffers[i]);
+    }
+}
+
+/* Writes the CNT (at most MAX_CMD_SECTORS) sectors starting at
+   SEC_NO to disk D from BUFFERS by PIO.  The disk interrupts
+   once per mult_cnt sectors.  The caller must hold D's channel
+   lock. */
+static void
+pio_write (struct ata_disk *d, block_sector_t sec_no, size_t cnt,
+           const void *buffers[])
+{
+  struct channel *c = d->channel;
+  size_t i;
+
+  select_sector (d, sec_no, cnt);
+  issue_pio_command (c, (d->mult_cnt > 1 ? CMD_WRITE_MULTIPLE
+                         : CMD_WRITE_SECTOR_RETRY));
+  for (i = 0; i < cnt; i++)
+    {
+      if (i % d->mult_cnt == 0)
+        {
+          if (i > 0)
+            wait_for_interrupt (c);
+          if (!wait_while_busy (d))
+            PANIC ("%s: disk write failed, sector=%"PRDSNu,
+                   d->name, sec_no + i);
+        }
+      output_sector (c, buffers[i]);
+    }
+  wait_for_interrupt (c);
+}
+
+/* Reads the CNT sectors starting at SEC_NO from disk D into
+   BUFFERS, each of which must have room for BLOCK_SECTOR_SIZE
+   bytes.  Each command covers up to MAX_CMD_SECTORS sectors.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 static void
-ide_read (void *d_, block_sector_t sec_no, void *buffer)
+ide_read_multiple (void *d_, block_sector_t sec_no, size_t cnt,
+                   void *buffers[])
 {
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
+  uint64_t start, wait_start;
+
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
+  start = rdtsc ();
+  wait_start = c->wait_cycles;
+  c->read_sectors += cnt;
+  while (cnt > 0)
+    {
+      size_t n = cnt < MAX_CMD_SECTORS ? cnt : MAX_CMD_SECTORS;
+
+      if (!d->dma || !dma_transfer (d, sec_no, n, (const void **) buffers,
+                                    false))
+        pio_read (d, sec_no, n, buffers);
+
+      sec_no += n;
+      buffers += n;
+      cnt -= n;
+    }
+  c->read_cycles += rdtsc () - start - (c->wait_cycles - wait_start);
   lock_release (&c->lock);
 }
 
-/* Write sector SEC_NO to disk D from BUFFER, which must contain
-   BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
-   acknowledged receiving the data.
+/* Writes the CNT sectors starting at SEC_NO to disk D from
+   BUFFERS, each of which must contain BLOCK_SECTOR_SIZE bytes.
+   Returns after the disk has acknowledged receiving the data.
+   Each command covers up to MAX_CMD_SECTORS sectors.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 static void
-ide_write (void *d_, block_sector_t sec_no, const void *buffer)
+ide_write_multiple (void *d_, block_sector_t sec_no, size_t cnt,
+                    const void *buffers[])
 {
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
+
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
+  while (cnt > 0)
+    {
+      size_t n = cnt < MAX_CMD_SECTORS ? cnt : MAX_CMD_SECTORS;
+
+      if (!d->dma || !dma_transfer (d, sec_no, n, buffers, true))
+        pio_write (d, sec_no, n, buffers);
+
+      sec_no += n;
+      buffers += n;
+      cnt -= n;
+    }
   lock_release (&c->lock);
 }
 
+/* Reads sector SEC_NO from disk D into BUFFER, which must have
+   room for BLOCK_SECTOR_SIZE bytes.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_read (void *d_, block_sector_t sec_no, void *buffer)
+{
+  ide_read_multiple (d_, sec_no, 1, &buffer);
+}
+
+/* Write sector SEC_NO to disk D from BUFFER, which must contain
+   BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
+   acknowledged receiving the data.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_write (void *d_, block_sector_t sec_no, const void *buffer)
+{
+  ide_write_multiple (d_, sec_no, 1, &buffer);
+}
+
 static struct block_operations ide_operations =
   {
     ide_read,
-    ide_write
+    ide_write,
+    ide_read_multiple,
+    ide_write_multiple
   };
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and the number of sectors to transfer, CNT, to
+   the disk's sector selection registers.  (We use LBA mode.) */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sector (struct ata_disk *d, block_sector_t sec_no, size_t cnt)
 {
   struct channel *c = d->channel;
 
   ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt > 0 && cnt <= MAX_CMD_SECTORS);
 
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt == MAX_CMD_SECTORS ? 0 : cnt);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
@@ -432,6 +804,17 @@ output_sector (struct channel *c, const void *sector)
 
 /* Low-level ATA primitives. */
 
+/* Waits for channel C's completion interrupt.  Counts the time
+   spent waiting, during which the CPU is free to run other
+   threads, in C's wait_cycles. */
+static void
+wait_for_interrupt (struct channel *c)
+{
+  uint64_t start = rdtsc ();
+  sema_down (&c->completion_wait);
+  c->wait_cycles += rdtsc () - start;
+}
+
 /* Wait up to 10 seconds for the controller to become idle, that
    is, for the BSY and DRQ bits to clear in the status register.
 
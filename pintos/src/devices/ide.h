@@ -1,6 +1,9 @@
 #ifndef DEVICES_IDE_H
 #define DEVICES_IDE_H
 
+#include <stdint.h>
+
 void ide_init (void);
+uint64_t ide_read_cycles_per_mb (void);
 
 #endif /* devices/ide.h */
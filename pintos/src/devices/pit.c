@@ -11,9 +11,6 @@
 #define PIT_PORT_CONTROL          0x43                /* Control port. */
 #define PIT_PORT_COUNTER(CHANNEL) (0x40 + (CHANNEL))  /* Counter port. */
 
-/* PIT cycles per second. */
-#define PIT_HZ 1193180
-
 /* Configure the given CHANNEL in the PIT.  In a PC, the PIT's
    three output channels are hooked up like this:
 
@@ -81,3 +78,51 @@ pit_configure_channel (int channel, int mode, int frequency)
   outb (PIT_PORT_COUNTER (channel), count >> 8);
   intr_set_level (old_level);
 }
+
+/* Starts the given CHANNEL counting down once from COUNT PIT
+   cycles, in mode 0.  The channel's output goes high, raising
+   an interrupt for channel 0, when the count runs out, and
+   stays high until the channel is configured again.  COUNT must
+   be between 1 and PIT_MAX_COUNT. */
+void
+pit_configure_oneshot (int channel, unsigned count)
+{
+  enum intr_level old_level;
+
+  ASSERT (channel == 0 || channel == 2);
+  ASSERT (count >= 1 && count <= PIT_MAX_COUNT);
+
+  /* A count of PIT_MAX_COUNT is loaded as 0. */
+  old_level = intr_disable ();
+  outb (PIT_PORT_CONTROL, (channel << 6) | 0x30);
+  outb (PIT_PORT_COUNTER (channel), count);
+  outb (PIT_PORT_COUNTER (channel), count >> 8);
+  intr_set_level (old_level);
+}
+
+/* Returns the number of PIT cycles left in the given CHANNEL's
+   current count.  If OUTPUT is nonnull, stores the channel's
+   output level in *OUTPUT; for a channel in mode 0, it is true
+   once the count has run out.  Uses the 8254 read-back command
+   to latch the status and count together. */
+unsigned
+pit_read_count (int channel, bool *output)
+{
+  enum intr_level old_level;
+  uint8_t status, low, high;
+  unsigned count;
+
+  ASSERT (channel == 0 || channel == 2);
+
+  old_level = intr_disable ();
+  outb (PIT_PORT_CONTROL, 0xc0 | (1 << (channel + 1)));
+  status = inb (PIT_PORT_COUNTER (channel));
+  low = inb (PIT_PORT_COUNTER (channel));
+  high = inb (PIT_PORT_COUNTER (channel));
+  intr_set_level (old_level);
+
+  if (output != NULL)
+    *output = (status & 0x80) != 0;
+  count = low | (high << 8);
+  return count != 0 ? count : PIT_MAX_COUNT;
+}
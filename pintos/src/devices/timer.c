@@ -17,18 +17,46 @@
 #error TIMER_FREQ <= 1000 recommended
 #endif
 
+/* PIT cycles per timer tick. */
+#define TICK_CYCLES ((PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ)
+
 /* Number of timer ticks since OS booted. */
 static int64_t ticks;
 
+/* If true, the periodic timer interrupt is stopped while only
+   the idle thread is runnable.  Set by the kernel's -tickless
+   option. */
+bool timer_tickless;
+
+/* While the idle thread runs in tickless mode, the PIT counts
+   down once to a tick boundary instead of interrupting every
+   tick.  oneshot_ticks is the number of ticks that countdown
+   stands for, or 0 if the PIT is in periodic mode.  The
+   countdown is oneshot_cycles long and crosses its first tick
+   boundary after oneshot_first cycles. */
+static int64_t oneshot_ticks;
+static unsigned oneshot_cycles;
+static unsigned oneshot_first;
+
+/* Number of ticks that passed without a timer interrupt. */
+static int64_t skipped_ticks;
+
+/* Threads blocked in timer_sleep(), in order of wake_tick.  Only
+   accessed with interrupts off, since timer_interrupt() drains
+   it. */
+static struct list sleep_list;
+
 /* Number of loops per timer tick.
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
 static intr_handler_func timer_interrupt;
+static list_less_func wakes_earlier;
 static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
 static void real_time_delay (int64_t num, int32_t denom);
+static void skip_ticks (int64_t cnt);
 
 /* Sets up the timer to interrupt TIMER_FREQ times per second,
    and registers the corresponding interrupt. */
@@ -36,6 +64,7 @@ void
 timer_init (void)
 {
   pit_configure_channel (0, 2, TIMER_FREQ);
+  list_init (&sleep_list);
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
 }
 
@@ -85,15 +114,24 @@ timer_elapsed (int64_t then)
 }
 
 /* Sleeps for approximately TICKS timer ticks.  Interrupts must
-   be turned on. */
+   be turned on.  The thread is blocked on sleep_list until the
+   timer interrupt that wakes it, so it takes no CPU time in the
+   meantime. */
 void
 timer_sleep (int64_t ticks)
 {
-  int64_t start = timer_ticks ();
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
 
   ASSERT (intr_get_level () == INTR_ON);
-  while (timer_elapsed (start) < ticks)
-    thread_yield ();
+  if (ticks <= 0)
+    return;
+
+  old_level = intr_disable ();
+  cur->wake_tick = timer_ticks () + ticks;
+  list_insert_ordered (&sleep_list, &cur->elem, wakes_earlier, NULL);
+  thread_block ();
+  intr_set_level (old_level);
 }
 
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
@@ -159,21 +197,155 @@ timer_ndelay (int64_t ns)
   real_time_delay (ns, 1000 * 1000 * 1000);
 }
 
+/* Called by the idle thread, with interrupts off, just before
+   it halts.  In tickless mode, replaces the periodic timer
+   interrupt by a single one at the tick when the first sleeper
+   is due.
+
+   The countdown keeps the phase of the periodic ticks, so
+   timer_ticks() stays exact.  It never runs past the next whole
+   second, so that once-a-second scheduler bookkeeping still
+   runs from a real timer interrupt, and it is limited to what
+   the 16-bit PIT counter holds, about 5 ticks at 100 Hz. */
+void
+timer_idle_enter (void)
+{
+  int64_t cnt, max_cnt;
+  unsigned first;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!timer_tickless || oneshot_ticks != 0)
+    return;
+
+  cnt = TIMER_FREQ - ticks % TIMER_FREQ;
+  if (!list_empty (&sleep_list))
+    {
+      struct thread *t = list_entry (list_front (&sleep_list),
+                                     struct thread, elem);
+      if (t->wake_tick - ticks < cnt)
+        cnt = t->wake_tick - ticks;
+    }
+
+  /* Cycles left until the next periodic tick.  Too close to the
+     tick, and it might be raised before the PIT is reprogrammed,
+     so stay periodic. */
+  first = pit_read_count (0, NULL);
+  if (first < TICK_CYCLES / 8 || first > TICK_CYCLES)
+    return;
+
+  max_cnt = 1 + (PIT_MAX_COUNT - first) / TICK_CYCLES;
+  if (cnt > max_cnt)
+    cnt = max_cnt;
+  if (cnt < 2)
+    return;
+
+  oneshot_ticks = cnt;
+  oneshot_first = first;
+  oneshot_cycles = first + (cnt - 1) * TICK_CYCLES;
+  pit_configure_oneshot (0, oneshot_cycles);
+}
+
+/* Called by the scheduler, with interrupts off, when the idle
+   thread is about to give up the CPU to another thread.  If
+   another interrupt ended a tickless countdown early, accounts
+   for the ticks that have passed and arms a countdown to the end
+   of the current tick, whose interrupt restarts the periodic
+   timer.  The other thread thus waits at most the rest of that
+   tick for its next timer interrupt. */
+void
+timer_idle_exit (void)
+{
+  unsigned elapsed, left;
+  int64_t passed;
+  bool expired;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (oneshot_ticks == 0)
+    return;
+
+  /* If the countdown has run out, its interrupt is pending and
+     does the accounting. */
+  elapsed = oneshot_cycles - pit_read_count (0, &expired);
+  if (expired)
+    return;
+
+  if (elapsed < oneshot_first)
+    {
+      passed = 0;
+      left = oneshot_first - elapsed;
+    }
+  else
+    {
+      passed = 1 + (elapsed - oneshot_first) / TICK_CYCLES;
+      left = TICK_CYCLES - (elapsed - oneshot_first) % TICK_CYCLES;
+    }
+  ASSERT (passed < oneshot_ticks);
+  skip_ticks (passed);
+
+  oneshot_ticks = 1;
+  oneshot_first = oneshot_cycles = left;
+  pit_configure_oneshot (0, left);
+}
+
 /* Prints timer statistics. */
 void
 timer_print_stats (void)
 {
-  printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
+  printf ("Timer: %"PRId64" ticks, %"PRId64" without an interrupt\n",
+          timer_ticks (), skipped_ticks);
 }
 
-/* Timer interrupt handler. */
+/* Accounts for CNT idle ticks that passed without a timer
+   interrupt.  None of them is the first tick of a second, and
+   no sleeper is due on any of them. */
+static void
+skip_ticks (int64_t cnt)
+{
+  ticks += cnt;
+  skipped_ticks += cnt;
+  thread_idle_ticks (cnt);
+}
+
+/* Timer interrupt handler.  Wakes the threads whose sleep has
+   run out, which are at the front of sleep_list. */
 static void
 timer_interrupt (struct intr_frame *args UNUSED)
 {
+  if (oneshot_ticks != 0)
+    {
+      /* A tickless countdown ran out.  Account for the ticks it
+         covered, except this one, and go back to periodic. */
+      skip_ticks (oneshot_ticks - 1);
+      oneshot_ticks = 0;
+      pit_configure_channel (0, 2, TIMER_FREQ);
+    }
+
   ticks++;
+  while (!list_empty (&sleep_list))
+    {
+      struct thread *t = list_entry (list_front (&sleep_list),
+                                     struct thread, elem);
+      if (t->wake_tick > ticks)
+        break;
+      list_pop_front (&sleep_list);
+      thread_unblock (t);
+    }
   thread_tick ();
 }
 
+/* Returns true if the thread that A belongs to should wake before
+   the one that B belongs to.  Threads that wake on the same tick
+   stay in the order in which they went to sleep. */
+static bool
+wakes_earlier (const struct list_elem *a, const struct list_elem *b,
+               void *aux UNUSED)
+{
+  return (list_entry (a, struct thread, elem)->wake_tick
+          < list_entry (b, struct thread, elem)->wake_tick);
+}
+
 /* Returns true if LOOPS iterations waits for more than one timer
    tick, otherwise false. */
 static bool
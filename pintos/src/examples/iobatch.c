@@ -0,0 +1,163 @@
+/* iobatch.c
+
+   Compares the throughput of reading many small files with plain
+   open, read and close system calls against queuing the same
+   operations on an I/O ring and submitting them with io_enter(),
+   which needs one trap into the kernel for many files.  Time is
+   measured as in iobench, at the clock rate given on the command
+   line in MHz, default 1000. */
+
+#include <cpu.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+
+#define FILE_CNT 48
+#define FILE_SIZE 512
+#define ROUNDS 8
+
+/* Operations per file: open, read, close. */
+#define OPS_PER_FILE 3
+
+static char names[FILE_CNT][16];
+static char buf[FILE_CNT][FILE_SIZE];
+static struct io_ring ring;
+
+/* Returns the throughput, in kB/s, of reading every file ROUNDS
+   times in CYCLES cycles at MHZ MHz. */
+static unsigned
+kb_per_sec (uint64_t cycles, unsigned mhz)
+{
+  if (cycles == 0)
+    cycles = 1;
+  return ((uint64_t) FILE_CNT * FILE_SIZE * ROUNDS * mhz * 1000000
+          / cycles / 1024);
+}
+
+/* Reads every file with plain system calls.  Returns the number
+   of bytes read. */
+static int
+read_plain (void)
+{
+  int total = 0;
+  int i;
+
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      int fd = open (names[i]);
+      if (fd < 0)
+        return -1;
+      total += read (fd, buf[i], FILE_SIZE);
+      close (fd);
+    }
+  return total;
+}
+
+/* Queues an operation on the ring. */
+static void
+submit (enum io_op op, int fd, void *buffer, size_t len, int user_data)
+{
+  struct io_sqe *sqe = &ring.sq[ring.sq_tail % IO_RING_ENTRIES];
+
+  sqe->op = op;
+  sqe->fd = fd;
+  sqe->buf = buffer;
+  sqe->len = len;
+  sqe->user_data = user_data;
+  ring.sq_tail++;
+}
+
+/* Reads every file through the ring, queuing as many files as
+   fit at a time.  Returns the number of bytes read. */
+static int
+read_ring (void)
+{
+  int total = 0;
+  int next = 0;
+
+  while (next < FILE_CNT)
+    {
+      int batch = 0;
+
+      while (next < FILE_CNT
+             && (batch + 1) * OPS_PER_FILE <= IO_RING_ENTRIES)
+        {
+          submit (IO_OPEN, 0, names[next], 0, IO_OPEN);
+          submit (IO_READ, IO_FD_PREV, buf[next], FILE_SIZE, IO_READ);
+          submit (IO_CLOSE, IO_FD_PREV, NULL, 0, IO_CLOSE);
+          next++;
+          batch++;
+        }
+      if (io_enter (&ring) != batch * OPS_PER_FILE)
+        return -1;
+
+      for (; ring.cq_head != ring.cq_tail; ring.cq_head++)
+        {
+          struct io_cqe *cqe = &ring.cq[ring.cq_head % IO_RING_ENTRIES];
+          if (cqe->result < 0)
+            return -1;
+          if (cqe->user_data == IO_READ)
+            total += cqe->result;
+        }
+    }
+  return total;
+}
+
+/* Runs READ_ALL ROUNDS times and returns the cycles it took, or
+   0 if it fails. */
+static uint64_t
+time_rounds (int (*read_all) (void))
+{
+  uint64_t start = rdtsc ();
+  int i;
+
+  for (i = 0; i < ROUNDS; i++)
+    if (read_all () != FILE_CNT * FILE_SIZE)
+      return 0;
+  return rdtsc () - start;
+}
+
+int
+main (int argc, char *argv[])
+{
+  unsigned mhz = argc > 1 ? atoi (argv[1]) : 1000;
+  uint64_t plain, batched;
+  int i;
+
+  if (mhz == 0)
+    {
+      printf ("usage: iobatch [MHZ]\n");
+      return EXIT_FAILURE;
+    }
+
+  memset (buf, 'x', sizeof buf);
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      int fd;
+
+      snprintf (names[i], sizeof names[i], "iobatch%d", i);
+      remove (names[i]);
+      if (!create (names[i], 0) || (fd = open (names[i])) < 0
+          || write (fd, buf[i], FILE_SIZE) != FILE_SIZE)
+        {
+          printf ("iobatch: cannot create %s\n", names[i]);
+          return EXIT_FAILURE;
+        }
+      close (fd);
+    }
+
+  plain = time_rounds (read_plain);
+  batched = time_rounds (read_ring);
+  if (plain == 0 || batched == 0)
+    printf ("iobatch: read failed\n");
+  else
+    printf ("%d files of %d bytes: plain %u kB/s, ring %u kB/s\n",
+            FILE_CNT, FILE_SIZE, kb_per_sec (plain, mhz),
+            kb_per_sec (batched, mhz));
+
+  for (i = 0; i < FILE_CNT; i++)
+    remove (names[i]);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,93 @@
+/* iobench.c
+
+   Measures the throughput of the read and write system calls for
+   a range of buffer sizes.  Each pass writes a file through a
+   buffer of the given size and then reads it back.  Time is
+   measured in CPU cycles with RDTSC and converted to MB/s at the
+   clock rate given on the command line, in MHz, which defaults
+   to 1000. */
+
+#include <cpu.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+
+#define FILE_NAME "iobench.dat"
+#define FILE_SIZE (256 * 1024)
+#define MAX_BUF (64 * 1024)
+
+static char buf[MAX_BUF];
+
+/* Returns the throughput, in MB/s, of moving FILE_SIZE bytes in
+   CYCLES cycles at MHZ MHz. */
+static unsigned
+mb_per_sec (uint64_t cycles, unsigned mhz)
+{
+  if (cycles == 0)
+    cycles = 1;
+  return (uint64_t) FILE_SIZE * mhz * 1000000 / cycles / (1024 * 1024);
+}
+
+/* Writes or reads, according to WRITE, the whole of the file open
+   as FD in BUF_SIZE chunks, and returns the cycles it took, or 0
+   if a call fails. */
+static uint64_t
+pass (int fd, size_t buf_size, bool write_)
+{
+  uint64_t start;
+  size_t ofs;
+
+  seek (fd, 0);
+  start = rdtsc ();
+  for (ofs = 0; ofs < FILE_SIZE; ofs += buf_size)
+    {
+      int n = write_ ? write (fd, buf, buf_size) : read (fd, buf, buf_size);
+      if (n != (int) buf_size)
+        return 0;
+    }
+  return rdtsc () - start;
+}
+
+int
+main (int argc, char *argv[])
+{
+  static const size_t sizes[] = {512, 4096, 16384, 65536};
+  unsigned mhz = argc > 1 ? atoi (argv[1]) : 1000;
+  size_t i;
+  int fd;
+
+  if (mhz == 0)
+    {
+      printf ("usage: iobench [MHZ]\n");
+      return EXIT_FAILURE;
+    }
+
+  memset (buf, 'x', sizeof buf);
+  remove (FILE_NAME);
+  if (!create (FILE_NAME, FILE_SIZE) || (fd = open (FILE_NAME)) < 0)
+    {
+      printf ("iobench: cannot create %s\n", FILE_NAME);
+      return EXIT_FAILURE;
+    }
+
+  printf ("%8s %12s %12s\n", "buffer", "write MB/s", "read MB/s");
+  for (i = 0; i < sizeof sizes / sizeof *sizes; i++)
+    {
+      uint64_t w = pass (fd, sizes[i], true);
+      uint64_t r = pass (fd, sizes[i], false);
+
+      if (w == 0 || r == 0)
+        {
+          printf ("iobench: I/O error with %zu-byte buffer\n", sizes[i]);
+          break;
+        }
+      printf ("%8zu %12u %12u\n", sizes[i], mb_per_sec (w, mhz),
+              mb_per_sec (r, mhz));
+    }
+
+  close (fd);
+  remove (FILE_NAME);
+  return EXIT_SUCCESS;
+}
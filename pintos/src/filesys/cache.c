@@ -0,0 +1,1036 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "filesys/filesys.h"
+#include "devices/timer.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Number of sectors packed into each page of cache memory. */
+#define SECTORS_PER_PAGE (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* The cache gives a page back to the kernel pool whenever a miss
+   finds fewer than POOL_LOW_WATER free kernel pages, and takes
+   another one only while more than POOL_HIGH_WATER are free. */
+#define POOL_LOW_WATER 16
+#define POOL_HIGH_WATER 64
+
+/* Writers are throttled against at least this many entries, so
+   that a cache that has just shrunk still absorbs a few dirty
+   sectors between flushes. */
+#define DIRTY_FLOOR (4 * SECTORS_PER_PAGE)
+
+/* Maximum number of pending read-ahead requests.  Further
+   requests are dropped until the read-ahead thread catches up. */
+#define READAHEAD_QUEUE 64
+
+/* Number of timer ticks between passes of the flusher thread. */
+#define FLUSH_INTERVAL TIMER_FREQ
+
+/* Number of independently locked partitions of the sector
+   index. */
+#define CACHE_BUCKETS 16
+
+/* A partition of the sector index.  Sector S is indexed in
+   bucket S % CACHE_BUCKETS, whose lock protects the bucket's hash
+   table and counters and the pin_cnt of every entry indexed in
+   it.  Hits on sectors in different buckets never contend. */
+struct cache_bucket
+  {
+    struct lock lock;
+    struct hash index;                  /* Maps sector to disk_block. */
+    int hits;                           /* Lookups served from cache. */
+    int misses;                         /* Lookups that read the disk. */
+    int prefetches;                     /* Sectors read ahead. */
+    int prefetch_hits;                  /* Hits on read-ahead sectors. */
+  };
+
+static struct cache_bucket buckets[CACHE_BUCKETS];
+
+/* Cache entries.  Room for cache_max entries is reserved up
+   front, but only the first cache_cnt are backed by memory.
+   Entries are added and removed a page (SECTORS_PER_PAGE
+   entries) at a time.
+
+   cache_lock protects cache_cnt, clock_hand and the empty flag
+   and sector_id of every entry, so it is held whenever an entry
+   is added to or removed from the index.  It is only taken on a
+   miss, and never held across disk I/O on the miss path.  Locks
+   are acquired in the order cache_lock, bucket lock,
+   block_lock. */
+static struct disk_block *cache;
+static size_t cache_cnt;
+static size_t cache_max;
+static size_t clock_hand;
+static struct lock cache_lock;
+
+/* Sectors waiting to be read ahead, as a ring buffer.  Protected
+   by readahead_lock; readahead_cond is signaled when a sector is
+   queued. */
+static block_sector_t readahead_queue[READAHEAD_QUEUE];
+static size_t readahead_head;
+static size_t readahead_cnt;
+static struct lock readahead_lock;
+static struct condition readahead_cond;
+
+/* Number of dirty entries, and the percentage of cache entries
+   that may be dirty before writers must write dirty sectors back
+   themselves.  Protected by dirty_lock. */
+static size_t dirty_cnt;
+static int dirty_pct;
+static struct lock dirty_lock;
+
+/* Serializes passes that write back dirty sectors, which share
+   flush_list as scratch space for cache_max entries. */
+static struct lock flush_lock;
+static struct disk_block **flush_list;
+
+/* Flags for cache_claim(). */
+enum claim_flags
+  {
+    CLAIM_PREFETCH = 001,       /* Reading ahead of use. */
+    CLAIM_TRY = 002             /* Fail instead of waiting for a victim. */
+  };
+
+static hash_hash_func cache_hash;
+static hash_less_func cache_less;
+static struct cache_bucket *bucket_of (block_sector_t);
+static struct disk_block *cache_find (struct hash *, block_sector_t);
+static struct disk_block *cache_lookup (struct cache_bucket *,
+                                        block_sector_t, bool prefetch);
+static void cache_unpin (struct disk_block *);
+static void cache_write_back (struct disk_block *);
+static bool cache_drop (struct disk_block *);
+static bool cache_grow (void);
+static void cache_shrink (void);
+static void cache_adjust (void);
+static struct disk_block *cache_evict (bool may_fail);
+static struct disk_block *cache_claim (block_sector_t, enum claim_flags,
+                                       bool *missed);
+static struct disk_block *cache_get (block_sector_t, bool fill);
+static void cache_put (struct disk_block *);
+static void cache_load (struct disk_block *[], size_t cnt);
+static size_t cache_fetch (const block_sector_t[], size_t cnt,
+                           struct disk_block *[], enum claim_flags);
+static thread_func readahead_thread NO_RETURN;
+static thread_func flusher_thread NO_RETURN;
+static void dirty_adjust (int delta);
+static bool dirty_over_limit (void);
+static void cache_write_dirty (void);
+static void cache_write_run (struct disk_block *[], size_t cnt);
+
+/* Initializes the buffer cache, which may grow to hold up to
+   MAX_SECTORS sectors, of which DIRTY_PCT percent may be dirty
+   before writers are throttled. */
+void
+cache_init (size_t max_sectors, int dirty_pct_)
+{
+  size_t i;
+
+  if (max_sectors < CACHE_MIN_SECTORS)
+    max_sectors = CACHE_MIN_SECTORS;
+  cache_max = ROUND_UP (max_sectors, SECTORS_PER_PAGE);
+  cache = malloc (cache_max * sizeof *cache);
+  flush_list = malloc (cache_max * sizeof *flush_list);
+  if (cache == NULL || flush_list == NULL)
+    PANIC ("buffer cache allocation failed");
+
+  for (i = 0; i < CACHE_BUCKETS; i++)
+    {
+      struct cache_bucket *bucket = &buckets[i];
+      lock_init (&bucket->lock);
+      if (!hash_init (&bucket->index, cache_hash, cache_less, NULL))
+        PANIC ("buffer cache allocation failed");
+      bucket->hits = 0;
+      bucket->misses = 0;
+      bucket->prefetches = 0;
+      bucket->prefetch_hits = 0;
+    }
+
+  lock_init (&cache_lock);
+  cache_cnt = 0;
+  clock_hand = 0;
+  while (cache_cnt < CACHE_MIN_SECTORS)
+    if (!cache_grow ())
+      PANIC ("buffer cache allocation failed");
+
+  lock_init (&readahead_lock);
+  cond_init (&readahead_cond);
+  readahead_head = readahead_cnt = 0;
+  thread_create ("readahead", PRI_DEFAULT, readahead_thread, NULL);
+
+  lock_init (&dirty_lock);
+  lock_init (&flush_lock);
+  dirty_cnt = 0;
+  dirty_pct = dirty_pct_;
+  thread_create ("flusher", PRI_DEFAULT, flusher_thread, NULL);
+}
+
+/* Writes back and then invalidates every cached sector that is
+   not in use, and resets the hit and miss counters. */
+void
+cache_clear (void)
+{
+  size_t i;
+
+  lock_acquire (&cache_lock);
+  for (i = 0; i < cache_cnt; i++)
+    cache_drop (&cache[i]);
+  for (i = 0; i < CACHE_BUCKETS; i++)
+    {
+      lock_acquire (&buckets[i].lock);
+      buckets[i].hits = 0;
+      buckets[i].misses = 0;
+      buckets[i].prefetches = 0;
+      buckets[i].prefetch_hits = 0;
+      lock_release (&buckets[i].lock);
+    }
+  lock_release (&cache_lock);
+}
+
+/* Writes every dirty sector back to disk. */
+void
+cache_flush (void)
+{
+  cache_write_dirty ();
+}
+
+/* Returns the number of lookups served from the cache. */
+int
+cache_hit_cnt (void)
+{
+  int hits = 0;
+  size_t i;
+
+  for (i = 0; i < CACHE_BUCKETS; i++)
+    hits += buckets[i].hits;
+  return hits;
+}
+
+/* Returns the number of lookups that had to read the disk. */
+int
+cache_miss_cnt (void)
+{
+  int misses = 0;
+  size_t i;
+
+  for (i = 0; i < CACHE_BUCKETS; i++)
+    misses += buckets[i].misses;
+  return misses;
+}
+
+/* Returns the number of hits on sectors that had been read
+   ahead, counting each read-ahead sector at most once. */
+int
+cache_prefetch_hit_cnt (void)
+{
+  int prefetch_hits = 0;
+  size_t i;
+
+  for (i = 0; i < CACHE_BUCKETS; i++)
+    prefetch_hits += buckets[i].prefetch_hits;
+  return prefetch_hits;
+}
+
+/* Prints buffer cache statistics. */
+void
+cache_print_stats (void)
+{
+  int hits = cache_hit_cnt ();
+  int misses = cache_miss_cnt ();
+  int accesses = hits + misses;
+  int prefetches = 0;
+  size_t i;
+
+  for (i = 0; i < CACHE_BUCKETS; i++)
+    prefetches += buckets[i].prefetches;
+
+  printf ("Cache: %zu of %zu sectors in %zu kB, "
+          "%d hits, %d misses (%d%% hit rate)\n",
+          cache_cnt, cache_max,
+          (cache_cnt / SECTORS_PER_PAGE * PGSIZE
+           + cache_max * sizeof *cache) / 1024,
+          hits, misses, accesses > 0 ? hits * 100 / accesses : 0);
+  printf ("Cache: %d sectors read ahead, %d used\n",
+          prefetches, cache_prefetch_hit_cnt ());
+}
+
+/* Returns the hash value for the cache entry containing E. */
+static unsigned
+cache_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct disk_block *b = hash_entry (e, struct disk_block, hash_elem);
+  return hash_int (b->sector_id);
+}
+
+/* Returns true if cache entry A caches a lower sector than B. */
+static bool
+cache_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct disk_block *a = hash_entry (a_, struct disk_block, hash_elem);
+  const struct disk_block *b = hash_entry (b_, struct disk_block, hash_elem);
+  return a->sector_id < b->sector_id;
+}
+
+/* Returns the bucket that indexes SECTOR. */
+static struct cache_bucket *
+bucket_of (block_sector_t sector)
+{
+  return &buckets[sector % CACHE_BUCKETS];
+}
+
+/* Returns the entry of INDEX that caches SECTOR, or a null
+   pointer if SECTOR is not cached. */
+static struct disk_block *
+cache_find (struct hash *index, block_sector_t sector)
+{
+  struct disk_block key;
+  struct hash_elem *e;
+
+  key.sector_id = sector;
+  e = hash_find (index, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct disk_block, hash_elem) : NULL;
+}
+
+/* Looks up SECTOR in BUCKET, which the caller must have locked,
+   and if it is cached pins its entry and returns it.  Unless
+   PREFETCH is true, also counts a hit.  Returns a null pointer
+   if SECTOR is not cached. */
+static struct disk_block *
+cache_lookup (struct cache_bucket *bucket, block_sector_t sector,
+              bool prefetch)
+{
+  struct disk_block *block = cache_find (&bucket->index, sector);
+  if (block != NULL)
+    {
+      block->pin_cnt++;
+      if (!prefetch)
+        {
+          bucket->hits++;
+          if (block->prefetched)
+            {
+              block->prefetched = false;
+              bucket->prefetch_hits++;
+            }
+        }
+    }
+  return block;
+}
+
+/* Drops a pin on BLOCK, which must be indexed. */
+static void
+cache_unpin (struct disk_block *block)
+{
+  struct cache_bucket *bucket = bucket_of (block->sector_id);
+
+  lock_acquire (&bucket->lock);
+  ASSERT (block->pin_cnt > 0);
+  block->pin_cnt--;
+  lock_release (&bucket->lock);
+}
+
+/* Writes BLOCK back to disk if it is dirty.  The caller must
+   have pinned BLOCK and must not hold its block_lock. */
+static void
+cache_write_back (struct disk_block *block)
+{
+  lock_acquire (&block->block_lock);
+  if (block->dirty)
+    {
+      block_write (fs_device, block->sector_id, block->data);
+      block->dirty = false;
+      dirty_adjust (-1);
+    }
+  lock_release (&block->block_lock);
+}
+
+/* Drops BLOCK from the sector index, unless some thread has it
+   pinned.  A dirty BLOCK is first pinned and written back with
+   cache_lock and its bucket lock released, so that the disk
+   write does not hold up other misses, and then reconsidered
+   once.  Returns true if BLOCK is now empty.  The caller must
+   hold cache_lock, which this function may release and
+   reacquire. */
+static bool
+cache_drop (struct disk_block *block)
+{
+  bool written = false;
+
+  for (;;)
+    {
+      struct cache_bucket *bucket;
+
+      if (block->empty)
+        return true;
+
+      bucket = bucket_of (block->sector_id);
+      lock_acquire (&bucket->lock);
+      if (block->pin_cnt > 0 || (block->dirty && written))
+        {
+          lock_release (&bucket->lock);
+          return false;
+        }
+      if (!block->dirty)
+        {
+          hash_delete (&bucket->index, &block->hash_elem);
+          block->sector_id = -1;
+          block->empty = true;
+          block->using = false;
+          lock_release (&bucket->lock);
+          return true;
+        }
+
+      block->pin_cnt++;
+      lock_release (&bucket->lock);
+      lock_release (&cache_lock);
+      cache_write_back (block);
+      cache_unpin (block);
+      lock_acquire (&cache_lock);
+      written = true;
+    }
+}
+
+/* Backs another SECTORS_PER_PAGE entries with a page from the
+   kernel pool.  Returns false if the cache is at its maximum size
+   or no page is available.  The caller must hold cache_lock,
+   except during initialization. */
+static bool
+cache_grow (void)
+{
+  uint8_t *page;
+  size_t i;
+
+  if (cache_cnt >= cache_max)
+    return false;
+  page = palloc_get_page (0);
+  if (page == NULL)
+    return false;
+
+  for (i = 0; i < SECTORS_PER_PAGE; i++)
+    {
+      struct disk_block *block = &cache[cache_cnt + i];
+      lock_init (&block->block_lock);
+      block->sector_id = -1;
+      block->data = page + i * BLOCK_SECTOR_SIZE;
+      block->pin_cnt = 0;
+      block->prefetched = false;
+      block->empty = true;
+      block->using = false;
+      block->dirty = false;
+    }
+
+  /* Point the clock hand at the new entries so that the next
+     misses fill them instead of evicting live sectors. */
+  clock_hand = cache_cnt;
+  cache_cnt += SECTORS_PER_PAGE;
+  return true;
+}
+
+/* Writes back and drops the entries on the cache's last page and
+   returns the page to the kernel pool.  Does nothing if any of
+   those entries stays pinned or dirty; a later miss will try
+   again.  The caller must hold cache_lock, which this function
+   may release while writing back entries. */
+static void
+cache_shrink (void)
+{
+  size_t cnt = cache_cnt;
+  size_t first = cnt - SECTORS_PER_PAGE;
+  size_t i;
+
+  ASSERT (cache_cnt > CACHE_MIN_SECTORS);
+
+  for (i = first; i < cnt; i++)
+    if (!cache_drop (&cache[i]) || cache_cnt != cnt)
+      return;
+
+  /* Entries dropped early may have been refilled while a later
+     one was written back.  Free the page only if every entry on
+     it is still empty, checked without releasing cache_lock. */
+  for (i = first; i < cnt; i++)
+    if (!cache[i].empty)
+      return;
+  palloc_free_page (cache[first].data);
+
+  cache_cnt = first;
+  if (clock_hand >= cache_cnt)
+    clock_hand = 0;
+}
+
+/* Grows or shrinks the cache by a page according to how many
+   pages are left in the kernel pool.  The caller must hold
+   cache_lock. */
+static void
+cache_adjust (void)
+{
+  size_t free_pages = palloc_free_cnt (0);
+
+  if (free_pages < POOL_LOW_WATER && cache_cnt > CACHE_MIN_SECTORS)
+    cache_shrink ();
+  else if (free_pages > POOL_HIGH_WATER && cache_cnt < cache_max)
+    cache_grow ();
+}
+
+/* Picks a cache entry to replace using the clock algorithm,
+   drops it from the sector index and returns it empty.  Pinned
+   entries are skipped, and so are dirty ones for the first lap
+   of the clock, since the flusher thread will soon clean them.
+   A dirty victim is written back with cache_lock released, so
+   the disk write does not hold up other misses, and then taken
+   if it is still clean and unpinned.  If every entry is pinned,
+   returns a null pointer when MAY_FAIL is true and otherwise
+   waits for an entry to be unpinned.  The caller must hold
+   cache_lock, which is held again on return. */
+static struct disk_block *
+cache_evict (bool may_fail)
+{
+  size_t steps = 0;
+
+  cache_adjust ();
+  for (;;)
+    {
+      struct disk_block *block = &cache[clock_hand];
+      struct cache_bucket *bucket;
+
+      clock_hand = (clock_hand + 1) % cache_cnt;
+      if (block->empty)
+        return block;
+
+      /* Every entry is pinned: let their holders finish. */
+      if (++steps > 2 * cache_cnt)
+        {
+          if (may_fail)
+            return NULL;
+          lock_release (&cache_lock);
+          thread_yield ();
+          lock_acquire (&cache_lock);
+          steps = 0;
+          continue;
+        }
+
+      bucket = bucket_of (block->sector_id);
+      lock_acquire (&bucket->lock);
+      if (block->pin_cnt > 0 || block->using)
+        {
+          block->using = false;
+          lock_release (&bucket->lock);
+        }
+      else if (block->dirty && steps <= cache_cnt)
+        lock_release (&bucket->lock);
+      else if (block->dirty)
+        {
+          block->pin_cnt++;
+          lock_release (&bucket->lock);
+          lock_release (&cache_lock);
+          cache_write_back (block);
+
+          /* Our pin kept BLOCK indexed under the same sector, so
+             take it now unless it was used or dirtied again. */
+          lock_acquire (&cache_lock);
+          lock_acquire (&bucket->lock);
+          block->pin_cnt--;
+          if (block->pin_cnt == 0 && !block->dirty && !block->using)
+            {
+              hash_delete (&bucket->index, &block->hash_elem);
+              block->sector_id = -1;
+              block->empty = true;
+              lock_release (&bucket->lock);
+              return block;
+            }
+          lock_release (&bucket->lock);
+        }
+      else
+        {
+          hash_delete (&bucket->index, &block->hash_elem);
+          block->sector_id = -1;
+          block->empty = true;
+          lock_release (&bucket->lock);
+          return block;
+        }
+    }
+}
+
+/* Returns the entry caching SECTOR, pinned, replacing another
+   entry on a miss.  On a hit, sets *MISSED to false; the entry's
+   block_lock is not held, and the caller must acquire it before
+   touching the data, which waits out any read still in flight.
+   On a miss, sets *MISSED to true and returns the new entry with
+   its block_lock held and its data not yet read.
+
+   A hit takes only the lock of SECTOR's bucket.  A miss also
+   takes cache_lock to claim an entry, but releases both before
+   returning, so the caller's disk read holds only the new
+   entry's block_lock.  Threads that miss on the same sector
+   meanwhile find the entry already indexed and wait on its
+   block_lock for that read.
+
+   With CLAIM_PREFETCH, SECTOR is being read ahead: counts neither
+   a hit nor a miss, marks a new entry as prefetched, and returns
+   a null pointer if SECTOR is already cached.  With CLAIM_TRY,
+   returns a null pointer, with *MISSED set to true, instead of
+   waiting when every entry is pinned.  Callers that already hold
+   pins must pass CLAIM_TRY, or they may wait on themselves. */
+static struct disk_block *
+cache_claim (block_sector_t sector, enum claim_flags flags, bool *missed)
+{
+  bool prefetch = (flags & CLAIM_PREFETCH) != 0;
+  struct cache_bucket *bucket = bucket_of (sector);
+  struct disk_block *block;
+  struct disk_block *victim;
+
+  *missed = false;
+  lock_acquire (&bucket->lock);
+  block = cache_lookup (bucket, sector, prefetch);
+  lock_release (&bucket->lock);
+
+  if (block == NULL)
+    {
+      lock_acquire (&cache_lock);
+      victim = cache_evict ((flags & CLAIM_TRY) != 0);
+
+      /* Another thread may have brought SECTOR in while we
+         waited for cache_lock or wrote back a victim. */
+      lock_acquire (&bucket->lock);
+      block = cache_lookup (bucket, sector, prefetch);
+      if (block == NULL && victim != NULL)
+        {
+          block = victim;
+          block->sector_id = sector;
+          block->pin_cnt = 1;
+          block->prefetched = prefetch;
+          block->empty = false;
+          block->dirty = false;
+          hash_insert (&bucket->index, &block->hash_elem);
+          if (prefetch)
+            bucket->prefetches++;
+          else
+            bucket->misses++;
+          lock_acquire (&block->block_lock);
+          *missed = true;
+        }
+      lock_release (&bucket->lock);
+      lock_release (&cache_lock);
+
+      if (block == NULL)
+        {
+          *missed = true;
+          return NULL;
+        }
+      if (*missed)
+        return block;
+    }
+
+  if (prefetch)
+    {
+      cache_unpin (block);
+      return NULL;
+    }
+  return block;
+}
+
+/* Returns the entry caching SECTOR, pinned and with its
+   block_lock held, replacing another entry on a miss.  A missed
+   sector is read from disk if FILL is true; callers about to
+   overwrite the whole sector pass false.  Release the entry with
+   cache_put(). */
+static struct disk_block *
+cache_get (block_sector_t sector, bool fill)
+{
+  bool missed;
+  struct disk_block *block = cache_claim (sector, 0, &missed);
+
+  if (!missed)
+    lock_acquire (&block->block_lock);
+  else if (fill)
+    block_read (fs_device, sector, block->data);
+  block->using = true;
+  return block;
+}
+
+/* Releases BLOCK, obtained from cache_get(). */
+static void
+cache_put (struct disk_block *block)
+{
+  lock_release (&block->block_lock);
+  cache_unpin (block);
+}
+
+/* Reads the CNT entries in BLOCKS, which cache consecutive
+   sectors and were just claimed by cache_claim(), from disk with
+   a single request, then releases their block_locks. */
+static void
+cache_load (struct disk_block *blocks[], size_t cnt)
+{
+  void *buffers[CACHE_BATCH_SECTORS];
+  size_t i;
+
+  if (cnt == 0)
+    return;
+  for (i = 0; i < cnt; i++)
+    buffers[i] = blocks[i]->data;
+  block_read_multiple (fs_device, blocks[0]->sector_id, cnt, buffers);
+  for (i = 0; i < cnt; i++)
+    lock_release (&blocks[i]->block_lock);
+}
+
+/* Brings the CNT (at most CACHE_BATCH_SECTORS) sectors in
+   SECTORS into the cache and stores their entries, pinned but
+   not locked, in BLOCKS.  Runs of missed sectors that are
+   consecutive on disk are read with one multi-sector request.
+   With CLAIM_PREFETCH in FLAGS, sectors that are already cached
+   get a null pointer in BLOCKS and no pin.
+
+   Stops early, rather than wait while holding pins, if the
+   cache runs out of unpinned entries.  Returns the number of
+   sectors handled, which is at least 1 if CNT is nonzero. */
+static size_t
+cache_fetch (const block_sector_t sectors[], size_t cnt,
+             struct disk_block *blocks[], enum claim_flags flags)
+{
+  size_t run_start = 0, run_cnt = 0;
+  size_t pin_cnt = 0;
+  size_t i;
+
+  ASSERT (cnt <= CACHE_BATCH_SECTORS);
+
+  for (i = 0; i < cnt; i++)
+    {
+      bool missed;
+
+      if (run_cnt > 0 && sectors[i] != sectors[i - 1] + 1)
+        {
+          cache_load (blocks + run_start, run_cnt);
+          run_cnt = 0;
+        }
+
+      blocks[i] = cache_claim (sectors[i],
+                               flags | (pin_cnt > 0 ? CLAIM_TRY : 0),
+                               &missed);
+      if (blocks[i] == NULL && missed)
+        break;
+      if (blocks[i] != NULL)
+        pin_cnt++;
+
+      if (missed)
+        {
+          if (run_cnt == 0)
+            run_start = i;
+          run_cnt++;
+        }
+      else if (run_cnt > 0)
+        {
+          cache_load (blocks + run_start, run_cnt);
+          run_cnt = 0;
+        }
+    }
+  cache_load (blocks + run_start, run_cnt);
+  return i;
+}
+
+/* Takes in a sector number and writes content from sector into the buffer.
+ * Looks in the cache first and updates cache with clock algorithm on miss.
+ * Buffer size must fit an entire sector. */
+void *
+read_sector (block_sector_t sector, void *buffer)
+{
+  cache_read (sector, buffer, 0, BLOCK_SECTOR_SIZE);
+  return buffer;
+}
+
+/* Copies SIZE bytes starting at OFFSET within SECTOR into
+   BUFFER, going through the cache. */
+void
+cache_read (block_sector_t sector, void *buffer, off_t offset, size_t size)
+{
+  struct disk_block *block = cache_get (sector, true);
+  memcpy (buffer, block->data + offset, size);
+  cache_put (block);
+}
+
+/* Copies SIZE bytes into BUFFER from the CNT (at most
+   CACHE_BATCH_SECTORS) sectors in SECTORS, taken as one stream of
+   data, starting OFFSET bytes into SECTORS[0].  Missed sectors
+   that are consecutive on disk are read with one request. */
+void
+cache_read_multiple (const block_sector_t sectors[], size_t cnt,
+                     void *buffer_, off_t offset, size_t size)
+{
+  struct disk_block *blocks[CACHE_BATCH_SECTORS];
+  uint8_t *buffer = buffer_;
+  size_t done = 0;
+
+  while (done < cnt && size > 0)
+    {
+      size_t fetched = cache_fetch (sectors + done, cnt - done, blocks, 0);
+      size_t i;
+
+      for (i = 0; i < fetched; i++)
+        {
+          struct disk_block *block = blocks[i];
+          size_t chunk = BLOCK_SECTOR_SIZE - offset;
+          if (chunk > size)
+            chunk = size;
+
+          lock_acquire (&block->block_lock);
+          block->using = true;
+          memcpy (buffer, block->data + offset, chunk);
+          cache_put (block);
+
+          buffer += chunk;
+          size -= chunk;
+          offset = 0;
+        }
+      done += fetched;
+    }
+}
+
+/* Takes a sector number and writes size bytes of the buffer into the sector starting at the offset..
+ * Writes the sector into the write-back buffer cache and writes to disk when evicted from the cache. */
+void
+write_sector (block_sector_t sector, const void *buffer, off_t offset,
+              size_t size)
+{
+  bool partial = offset != 0 || size != BLOCK_SECTOR_SIZE;
+  struct disk_block *block;
+
+  if (dirty_over_limit ())
+    cache_write_dirty ();
+
+  block = cache_get (sector, partial);
+  memcpy (block->data + offset, buffer, size);
+  if (!block->dirty)
+    {
+      block->dirty = true;
+      dirty_adjust (1);
+    }
+  cache_put (block);
+}
+
+/* Asks the read-ahead thread to bring SECTOR into the cache.
+   The request is dropped if too many are already pending. */
+void
+cache_readahead (block_sector_t sector)
+{
+  lock_acquire (&readahead_lock);
+  if (readahead_cnt < READAHEAD_QUEUE)
+    {
+      readahead_queue[(readahead_head + readahead_cnt++) % READAHEAD_QUEUE]
+        = sector;
+      cond_signal (&readahead_cond, &readahead_lock);
+    }
+  lock_release (&readahead_lock);
+}
+
+/* Reads queued sectors into the cache for as long as the kernel
+   runs.  Takes up to CACHE_BATCH_SECTORS requests at a time, so
+   that runs of consecutive sectors are read with one request. */
+static void
+readahead_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      block_sector_t sectors[CACHE_BATCH_SECTORS];
+      struct disk_block *blocks[CACHE_BATCH_SECTORS];
+      size_t cnt, done;
+
+      lock_acquire (&readahead_lock);
+      while (readahead_cnt == 0)
+        cond_wait (&readahead_cond, &readahead_lock);
+      for (cnt = 0; cnt < CACHE_BATCH_SECTORS && readahead_cnt > 0; cnt++)
+        {
+          sectors[cnt] = readahead_queue[readahead_head];
+          readahead_head = (readahead_head + 1) % READAHEAD_QUEUE;
+          readahead_cnt--;
+        }
+      lock_release (&readahead_lock);
+
+      for (done = 0; done < cnt; )
+        {
+          size_t fetched = cache_fetch (sectors + done, cnt - done, blocks,
+                                        CLAIM_PREFETCH);
+          size_t i;
+
+          for (i = 0; i < fetched; i++)
+            if (blocks[i] != NULL)
+              cache_unpin (blocks[i]);
+          done += fetched;
+        }
+    }
+}
+
+/* Adds DELTA to the number of dirty entries. */
+static void
+dirty_adjust (int delta)
+{
+  lock_acquire (&dirty_lock);
+  dirty_cnt += delta;
+  lock_release (&dirty_lock);
+}
+
+/* Returns true if more dirty entries are cached than dirty_pct
+   percent of the cache's current size, or of DIRTY_FLOOR if the
+   cache is smaller than that.  cache_cnt is read without
+   cache_lock; a stale value only shifts the limit briefly. */
+static bool
+dirty_over_limit (void)
+{
+  size_t size = cache_cnt > DIRTY_FLOOR ? cache_cnt : DIRTY_FLOOR;
+  bool over;
+
+  lock_acquire (&dirty_lock);
+  over = dirty_cnt * 100 > (size_t) dirty_pct * size;
+  lock_release (&dirty_lock);
+  return over;
+}
+
+/* Orders cache entries *A_ and *B_ by the sectors they cache,
+   for sorting with qsort(). */
+static int
+compare_sectors (const void *a_, const void *b_)
+{
+  const struct disk_block *a = *(struct disk_block * const *) a_;
+  const struct disk_block *b = *(struct disk_block * const *) b_;
+  return a->sector_id < b->sector_id ? -1 : a->sector_id > b->sector_id;
+}
+
+/* Writes every dirty sector back to disk in ascending sector
+   order, to keep seeks short, with one request per run of
+   consecutive sectors.  The dirty entries are pinned
+   while cache_lock is held and written back after it has been
+   released, so lookups and misses proceed in the meantime. */
+static void
+cache_write_dirty (void)
+{
+  size_t cnt = 0;
+  size_t i, run;
+
+  lock_acquire (&flush_lock);
+  lock_acquire (&cache_lock);
+  for (i = 0; i < cache_cnt; i++)
+    {
+      struct disk_block *block = &cache[i];
+      struct cache_bucket *bucket;
+
+      if (block->empty)
+        continue;
+      bucket = bucket_of (block->sector_id);
+      lock_acquire (&bucket->lock);
+      if (block->dirty)
+        {
+          block->pin_cnt++;
+          flush_list[cnt++] = block;
+        }
+      lock_release (&bucket->lock);
+    }
+  lock_release (&cache_lock);
+
+  qsort (flush_list, cnt, sizeof *flush_list, compare_sectors);
+  for (i = 0; i < cnt; i += run)
+    {
+      run = 1;
+      while (i + run < cnt && run < CACHE_BATCH_SECTORS
+             && flush_list[i + run]->sector_id == flush_list[i]->sector_id + run)
+        run++;
+      cache_write_run (flush_list + i, run);
+    }
+  lock_release (&flush_lock);
+}
+
+/* Writes the CNT pinned entries in BLOCKS, which cache
+   consecutive sectors, back to disk with a single request, and
+   then unpins them. */
+static void
+cache_write_run (struct disk_block *blocks[], size_t cnt)
+{
+  const void *buffers[CACHE_BATCH_SECTORS];
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    {
+      lock_acquire (&blocks[i]->block_lock);
+      buffers[i] = blocks[i]->data;
+    }
+  block_write_multiple (fs_device, blocks[0]->sector_id, cnt, buffers);
+  for (i = 0; i < cnt; i++)
+    {
+      if (blocks[i]->dirty)
+        {
+          blocks[i]->dirty = false;
+          dirty_adjust (-1);
+        }
+      lock_release (&blocks[i]->block_lock);
+      cache_unpin (blocks[i]);
+    }
+}
+
+/* Writes dirty sectors back to disk every FLUSH_INTERVAL ticks,
+   for as long as the kernel runs. */
+static void
+flusher_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_sleep (FLUSH_INTERVAL);
+      cache_write_dirty ();
+    }
+}
+
+/* Runs lookups against an index of ENTRIES fake cache entries for
+   about BENCH_TICKS timer ticks, first by scanning the entries
+   linearly as the cache used to and then through a sector index,
+   and prints the average cost of a lookup for each. */
+#define BENCH_TICKS 50
+void
+cache_bench (size_t entries)
+{
+  struct disk_block *blocks;
+  struct hash index;
+  unsigned long long scan_cnt = 0, hash_cnt = 0;
+  int64_t start, scan_ticks, hash_ticks;
+  size_t i;
+
+  blocks = malloc (entries * sizeof *blocks);
+  if (blocks == NULL || !hash_init (&index, cache_hash, cache_less, NULL))
+    {
+      printf ("cache-bench: out of memory for %zu entries\n", entries);
+      free (blocks);
+      return;
+    }
+  for (i = 0; i < entries; i++)
+    {
+      blocks[i].sector_id = i * 7;
+      hash_insert (&index, &blocks[i].hash_elem);
+    }
+
+  start = timer_ticks ();
+  while ((scan_ticks = timer_elapsed (start)) < BENCH_TICKS)
+    for (i = 0; i < entries; i++, scan_cnt++)
+      {
+        block_sector_t sector = (scan_cnt * 7) % (entries * 7);
+        size_t j;
+        for (j = 0; j < entries; j++)
+          if (blocks[j].sector_id == sector)
+            break;
+        ASSERT (j < entries);
+      }
+
+  start = timer_ticks ();
+  while ((hash_ticks = timer_elapsed (start)) < BENCH_TICKS)
+    for (i = 0; i < entries; i++, hash_cnt++)
+      if (cache_find (&index, (hash_cnt * 7) % (entries * 7)) == NULL)
+        PANIC ("cache-bench: sector missing from index");
+
+  printf ("cache-bench: %zu entries: linear scan %llu ns/lookup, "
+          "hash index %llu ns/lookup\n", entries,
+          scan_ticks * (1000000000ULL / TIMER_FREQ) / scan_cnt,
+          hash_ticks * (1000000000ULL / TIMER_FREQ) / hash_cnt);
+
+  hash_destroy (&index, NULL);
+  free (blocks);
+}
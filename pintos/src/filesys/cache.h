@@ -0,0 +1,67 @@
+#ifndef FILESYS_CACHE_H
+#define FILESYS_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <hash.h>
+#include "devices/block.h"
+#include "filesys/off_t.h"
+#include "threads/synch.h"
+
+/* Default and minimum number of sectors in the buffer cache.
+   The maximum is set with the kernel's -cache=N option. */
+#define CACHE_DEFAULT_SECTORS 64
+#define CACHE_MIN_SECTORS 16
+
+/* Default percentage of cached sectors that may be dirty before
+   writers have to write dirty sectors back themselves.  Set with
+   the kernel's -dirty=PCT option. */
+#define CACHE_DEFAULT_DIRTY_PCT 20
+
+/* Most sectors moved between the cache and the disk in one
+   multi-sector request. */
+#define CACHE_BATCH_SECTORS 16
+
+/* Number of sectors read ahead of a sequential reader. */
+#define READAHEAD_SECTORS 8
+
+/* A cached disk sector.
+
+   An entry is pinned while a thread is using it or waiting for
+   it, which keeps it from being evicted.  block_lock is held
+   while its data is being read from or written to disk, so
+   threads that find a sector still being loaded wait for that
+   read instead of issuing their own. */
+struct disk_block
+  {
+    struct hash_elem hash_elem;         /* Element in the sector index. */
+    struct lock block_lock;             /* Protects data and dirty. */
+    block_sector_t sector_id;
+    uint8_t *data;                      /* BLOCK_SECTOR_SIZE bytes, packed
+                                           with its neighbours in a page. */
+    int pin_cnt;                        /* Number of threads using entry. */
+    bool prefetched;                    /* Read ahead and not yet used. */
+    bool using;
+    bool empty;
+    bool dirty;
+  };
+
+void cache_init (size_t max_sectors, int dirty_pct);
+void cache_clear (void);
+void cache_flush (void);
+void cache_print_stats (void);
+void cache_bench (size_t entries);
+int cache_hit_cnt (void);
+int cache_miss_cnt (void);
+int cache_prefetch_hit_cnt (void);
+
+void *read_sector (block_sector_t sector, void *buffer);
+void cache_read (block_sector_t sector, void *buffer, off_t offset,
+                 size_t size);
+void cache_read_multiple (const block_sector_t sectors[], size_t cnt,
+                          void *buffer, off_t offset, size_t size);
+void write_sector (block_sector_t sector, const void *buffer, off_t offset,
+                   size_t size);
+void cache_readahead (block_sector_t sector);
+
+#endif /* filesys/cache.h */
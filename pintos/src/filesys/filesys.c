@@ -2,6 +2,7 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/directory.h"
@@ -13,12 +14,13 @@
 /* Partition that contains the file system. */
 struct block *fs_device;
 
-static void do_format (void);
+static void do_format (bool extents);
 
 /* Initializes the file system module.
-   If FORMAT is true, reformats the file system. */
+   If FORMAT is true, reformats the file system, with extent-based
+   inodes if EXTENTS is true. */
 void
-filesys_init (bool format)
+filesys_init (bool format, bool extents)
 {
   fs_device = block_get_role (BLOCK_FILESYS);
   if (fs_device == NULL)
@@ -28,7 +30,9 @@ filesys_init (bool format)
   free_map_init ();
 
   if (format)
-    do_format ();
+    do_format (extents);
+  else
+    inode_detect_layout ();
 
   free_map_open ();
 }
@@ -38,23 +42,8 @@ filesys_init (bool format)
 void
 filesys_done (void)
 {
-  int i;
-  struct disk_block *temp;
-  lock_acquire (&cache_lock);
-  for (i = 0; i < 64; i++) 
-    {
-      temp = cache[i];
-      if (temp->dirty)
-        {
-          lock_acquire (&temp->block_lock);
-          block_write (fs_device, temp->sector_id, temp->data);
-          lock_release (&temp->block_lock);
-        }
-      palloc_free_page (temp);
-    }
-  lock_release (&cache_lock);
+  cache_flush ();
   free_map_close ();
-
 }
 
 /* Creates a file named NAME with the given INITIAL_SIZE.
@@ -147,12 +136,8 @@ filesys_remove (const char *name)
   if (!success)
     return false;
 
-  struct inode_disk *metadata;
-  uint8_t buffer[BLOCK_SECTOR_SIZE];
-  metadata = read_sector(inode->sector, buffer);
-
   struct dir *to_remove = dir_open (inode);
-  if (!metadata->is_dir)
+  if (!inode_is_dir (inode))
     success = dir_remove (par_dir, last_name);
   else
     {
@@ -181,11 +166,13 @@ filesys_remove (const char *name)
   return success;
 }
 
-/* Formats the file system. */
+/* Formats the file system, giving its files extent-based inodes
+   if EXTENTS is true. */
 static void
-do_format (void)
+do_format (bool extents)
 {
   printf ("Formatting file system...");
+  inode_set_extents (extents);
   free_map_create ();
   if (!dir_create (ROOT_DIR_SECTOR, 16))
     PANIC ("root directory creation failed");
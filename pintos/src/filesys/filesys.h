@@ -12,7 +12,7 @@
 /* Block device that contains the file system. */
 struct block *fs_device;
 
-void filesys_init (bool format);
+void filesys_init (bool format, bool extents);
 void filesys_done (void);
 bool filesys_create (const char *name, off_t initial_size);
 struct file *filesys_open (const char *name);
@@ -40,6 +40,24 @@ free_map_allocate (size_t cnt, block_sector_t *sectorp)
   return sector != BITMAP_ERROR;
 }
 
+/* Allocates the CNT consecutive sectors starting at SECTOR.
+   Returns true if successful, false if any of them is already in
+   use or the free_map file could not be written. */
+bool
+free_map_allocate_at (block_sector_t sector, size_t cnt)
+{
+  if (sector + cnt > bitmap_size (free_map)
+      || !bitmap_none (free_map, sector, cnt))
+    return false;
+  bitmap_set_multiple (free_map, sector, cnt, true);
+  if (free_map_file != NULL && !bitmap_write (free_map, free_map_file))
+    {
+      bitmap_set_multiple (free_map, sector, cnt, false);
+      return false;
+    }
+  return true;
+}
+
 /* Makes CNT sectors starting at SECTOR available for use. */
 void
 free_map_release (block_sector_t sector, size_t cnt)
@@ -4,6 +4,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ustar.h>
+#include "filesys/cache.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
@@ -220,3 +221,13 @@ fsutil_append (char **argv)
   file_close (src);
   free (buffer);
 }
+
+/* Reports the cost of a buffer cache lookup for a cache the size
+   of the one in use and for a much larger one. */
+void
+fsutil_cache_bench (char **argv UNUSED)
+{
+  printf ("Benchmarking buffer cache lookups...\n");
+  cache_bench (CACHE_DEFAULT_SECTORS);
+  cache_bench (4096);
+}
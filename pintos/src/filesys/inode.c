@@ -3,69 +3,31 @@
 #include <debug.h>
 #include <round.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
-#include "threads/palloc.h"
 
-/* Identifies an inode. */
+/* Identifies an inode with block pointers. */
 #define INODE_MAGIC 0x494e4f44
 
-void write_sector(block_sector_t sector, void* buffer, off_t offset, size_t size);
+/* Identifies an inode with a list of extents. */
+#define EXTENT_MAGIC 0x494e4f45
+
+/* True if newly created inodes use extents. */
+static bool use_extents;
+
 bool calculate_index(block_sector_t block_num, int *indices, int *num_indices);
 
 bool change_block_count(struct inode_disk *id, block_sector_t block, bool add);
 bool inode_resize(struct inode_disk *id, size_t size);
+static bool extent_resize (struct inode_disk *, off_t size);
 
 struct indirect_block
   {
     block_sector_t pointers[NUM_BLOCK_POINTERS];
   };
 
-void
-cache_init (void)
-{
-  int i;
-  for (i = 0; i < 64; i++) 
-    {
-      struct disk_block *block = palloc_get_page(0);
-      lock_init (&block->block_lock);
-      memset (block->data, 0, BLOCK_SECTOR_SIZE);
-      block->sector_id = -1;
-      block->empty = true;
-      block->using = false;
-      block->dirty = false;
-      cache[i] = block;
-    }
-
-  clock_hand = 0;
-  cache_hits = 0;
-  cache_misses = 0;
-  lock_init (&cache_lock);
-}
-
-void
-cache_clear (void)
-{
-  int i;
-  lock_acquire (&cache_lock);
-  for (i = 0; i < 64; i++) 
-    {
-      struct disk_block *block = cache[i];
-      lock_acquire (&block->block_lock);
-      block->sector_id = -1;
-      block->empty = true;
-      block->using = false;
-      block->dirty = false;
-      lock_release (&block->block_lock);
-    }
-
-  cache_hits = 0;
-  cache_misses = 0;
-  lock_release (&cache_lock);
-}
-
-
 /* Returns the number of sectors to allocate for an inode SIZE
    bytes long. */
 static inline size_t
@@ -79,85 +41,50 @@ bytes_to_sectors (off_t size)
    Returns -1 if INODE does not contain data for a byte at offset
    POS. */
 static block_sector_t
-byte_to_sector (const struct inode *inode, off_t pos)
+byte_to_sector (struct inode *inode, off_t pos)
 {
-  ASSERT (inode != NULL);
-
-  struct inode_disk *id;
-  uint8_t buffer[BLOCK_SECTOR_SIZE];
-  id = read_sector(inode -> sector, buffer);
-
-  int result = 0;
-
-  size_t block = pos / BLOCK_SECTOR_SIZE;
+  block_sector_t result;
   int indices[3];
   int num_indices;
-  calculate_index(block, indices, &num_indices);
-  struct indirect_block *cur = malloc(sizeof(struct indirect_block));
-
-  result = id -> pointers[indices[0]];
-  if (num_indices > 1) {
-    if (result == 0)
-      goto done;
-    read_sector(result, cur->pointers);
-    result = cur->pointers[indices[1]];
-  }
-  if (num_indices > 2) {
-    if (result == 0)
-      goto done;
-    read_sector(result, cur->pointers);
-  }
-
-done:
-  free(cur);
-  if (result != 0)
-    return result;
-  return -1;
-}
-
-/* Takes in a sector number and writes content from sector into the buffer.
- * Looks in the cache first and updates cache with clock algorithm on miss.
- * Buffer size must fit an entire sector. */
-void *
-read_sector (block_sector_t sector, void *buffer)
-{
   int i;
-  struct disk_block *block = NULL;
-  lock_acquire (&cache_lock);
 
-  for (i = 0; i < 64; i++)
+  ASSERT (inode != NULL);
+
+  lock_acquire (&inode->lock);
+  if (inode->data.magic == EXTENT_MAGIC)
     {
-      if (cache[i]->sector_id == sector) 
+      const struct inode_disk *id = &inode->data;
+      size_t block = pos / BLOCK_SECTOR_SIZE;
+      uint32_t e;
+
+      result = -1;
+      for (e = 0; e < id->extent_cnt; e++)
         {
-          block = cache[i];
-          break;
+          if (block < id->extents[e].length)
+            {
+              result = id->extents[e].start + block;
+              break;
+            }
+          block -= id->extents[e].length;
         }
+      lock_release (&inode->lock);
+      return result;
     }
 
-  if (block != NULL)
-    {
-      lock_acquire (&block->block_lock);
-      cache_hits++;
-      lock_release (&cache_lock);
-      block->using = true;
-      memcpy (buffer, block->data, BLOCK_SECTOR_SIZE);
-      lock_release (&block->block_lock);
-    }
-  else 
+  if (!calculate_index (pos / BLOCK_SECTOR_SIZE, indices, &num_indices))
     {
-      struct disk_block *to_replace = clock_algorithm ();
-      cache_misses++;
-      lock_acquire (&to_replace->block_lock);
-      to_replace->sector_id = sector;
-      to_replace->using = true;
-      to_replace->empty = false;
-      to_replace->dirty = false;
-      block_read (fs_device, sector, to_replace->data);
-      memcpy (buffer, to_replace->data, BLOCK_SECTOR_SIZE);
-      lock_release (&to_replace->block_lock);
-      lock_release (&cache_lock);
+      lock_release (&inode->lock);
+      return -1;
     }
-  return buffer;
+
+  /* Only the one pointer needed at each level of indirection is
+     copied out of the cache. */
+  result = inode->data.pointers[indices[0]];
+  for (i = 1; i < num_indices && result != 0; i++)
+    cache_read (result, &result, indices[i] * sizeof result, sizeof result);
+  lock_release (&inode->lock);
+
+  return result != 0 ? result : (block_sector_t) -1;
 }
 
 /* List of open inodes, so that opening a single inode twice
@@ -172,6 +99,24 @@ inode_init (void)
   lock_init (&freemap_lock);
 }
 
+/* Makes inodes created from now on use a list of extents if
+   EXTENTS is true, or block pointers otherwise. */
+void
+inode_set_extents (bool extents)
+{
+  use_extents = extents;
+}
+
+/* Sets the layout of new inodes to match the file system on
+   disk, as recorded in the free map's inode. */
+void
+inode_detect_layout (void)
+{
+  struct inode_disk id;
+  read_sector (FREE_MAP_SECTOR, &id);
+  use_extents = id.magic == EXTENT_MAGIC;
+}
+
 /* Initializes an inode with LENGTH bytes of data and
    writes the new inode to sector SECTOR on the file system
    device.
@@ -194,7 +139,7 @@ inode_create (block_sector_t sector, off_t length, bool is_dir)
     {
       disk_inode->length = 0;
       disk_inode->is_dir = is_dir;
-      disk_inode->magic = INODE_MAGIC;
+      disk_inode->magic = use_extents ? EXTENT_MAGIC : INODE_MAGIC;
       if (inode_resize (disk_inode, length))
         {
           write_sector (sector, disk_inode, 0, BLOCK_SECTOR_SIZE);
@@ -238,6 +183,10 @@ inode_open (block_sector_t sector)
   inode->deny_write_cnt = 0;
   inode->removed = false;
   lock_init (&inode->dw_lock);
+  lock_init (&inode->lock);
+  read_sector (sector, &inode->data);
+  inode->read_next = 0;
+  inode->readahead_end = 0;
   return inode;
 }
 
@@ -277,15 +226,16 @@ inode_close (struct inode *inode)
       if (inode->removed)
         {
 
-          struct inode_disk *data;
-          uint8_t buffer[BLOCK_SECTOR_SIZE];
-          data = read_sector (inode->sector, buffer);
-          
           free_map_release (inode->sector, 1);
-          int cur_dealloc;
-          int num_blocks = bytes_to_sectors (data->length);
-          for (cur_dealloc = 0; cur_dealloc < num_blocks; cur_dealloc++)
-            change_block_count (data, cur_dealloc, false);
+          if (inode->data.magic == EXTENT_MAGIC)
+            extent_resize (&inode->data, 0);
+          else
+            {
+              int cur_dealloc;
+              int num_blocks = bytes_to_sectors (inode->data.length);
+              for (cur_dealloc = 0; cur_dealloc < num_blocks; cur_dealloc++)
+                change_block_count (&inode->data, cur_dealloc, false);
+            }
         }
       free (inode);
     }
@@ -311,62 +261,59 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
 
   while (size > 0)
     {
-      /* Disk sector to read, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      /* Disk sectors to read, starting byte offset within the
+         first.  Up to CACHE_BATCH_SECTORS sectors are read at once
+         so that consecutive misses become one disk request. */
+      block_sector_t sectors[CACHE_BATCH_SECTORS];
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
+      size_t sector_cnt, i;
 
-      /* Bytes left in inode, bytes left in sector, lesser of the two. */
+      /* Bytes left in inode, bytes left in batch, lesser of the two. */
       off_t inode_left = inode_length (inode) - offset;
-      int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
-      int min_left = inode_left < sector_left ? inode_left : sector_left;
+      off_t batch_left = CACHE_BATCH_SECTORS * BLOCK_SECTOR_SIZE - sector_ofs;
+      off_t min_left = inode_left < batch_left ? inode_left : batch_left;
 
-      /* Number of bytes to actually copy out of this sector. */
-      int chunk_size = size < min_left ? size : min_left;
+      /* Number of bytes to actually copy out of this batch. */
+      off_t chunk_size = size < min_left ? size : min_left;
       if (chunk_size <= 0)
         break;
 
-      int i;
-      struct disk_block *block = NULL;
-      lock_acquire (&cache_lock);
-
-      for (i = 0; i < 64; i++)
-        {
-          if (cache[i]->sector_id == sector_idx) 
-            {
-              block = cache[i];
-              break;
-            }
-        }
-
-      if (block != NULL)
-        {
-          lock_acquire (&block->block_lock);
-          cache_hits++;
-          lock_release (&cache_lock);
-          block->using = true;
-          memcpy (buffer + bytes_read, block->data + sector_ofs, chunk_size);
-          lock_release (&block->block_lock);
-        }
-      else 
-        {
-          struct disk_block *to_replace = clock_algorithm ();
-          lock_acquire (&to_replace->block_lock);
-          to_replace->sector_id = sector_idx;
-          to_replace->using = true;
-          to_replace->empty = false;
-          to_replace->dirty = false;
-          cache_misses++;
-          block_read (fs_device, sector_idx, to_replace->data);
-          memcpy (buffer + bytes_read, to_replace->data + sector_ofs, chunk_size);
-          lock_release (&to_replace->block_lock);
-          lock_release (&cache_lock);
-        }
+      sector_cnt = DIV_ROUND_UP (sector_ofs + chunk_size, BLOCK_SECTOR_SIZE);
+      for (i = 0; i < sector_cnt; i++)
+        sectors[i] = byte_to_sector (inode, offset - sector_ofs
+                                            + i * BLOCK_SECTOR_SIZE);
+      cache_read_multiple (sectors, sector_cnt, buffer + bytes_read,
+                           sector_ofs, chunk_size);
 
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_read += chunk_size;
     }
+
+  /* When INODE is being read sequentially, queue the sectors
+     following this read so that they are cached by the time the
+     reader gets to them. */
+  if (bytes_read > 0 && offset - bytes_read == inode->read_next)
+    {
+      off_t length = inode_length (inode);
+      off_t end = ROUND_UP (offset, BLOCK_SECTOR_SIZE)
+                  + READAHEAD_SECTORS * BLOCK_SECTOR_SIZE;
+      off_t pos = ROUND_UP (offset, BLOCK_SECTOR_SIZE);
+
+      if (pos < inode->readahead_end)
+        pos = inode->readahead_end;
+      for (; pos < end && pos < length; pos += BLOCK_SECTOR_SIZE)
+        {
+          block_sector_t sector = byte_to_sector (inode, pos);
+          if (sector != (block_sector_t) -1)
+            cache_readahead (sector);
+        }
+      inode->readahead_end = pos;
+    }
+  else
+    inode->readahead_end = 0;
+  inode->read_next = offset;
   return bytes_read;
 }
 
@@ -467,7 +414,7 @@ change_block_count (struct inode_disk *id, block_sector_t block, bool add)
                   free (cur);
                   return false;
                 }
-              cur->pointers[indices[1]] = new_block;
+              cur->pointers[indices[2]] = new_block;
               write_sector (indirect_block, cur->pointers, 0, BLOCK_SECTOR_SIZE);
             }
         }
@@ -511,6 +458,9 @@ change_block_count (struct inode_disk *id, block_sector_t block, bool add)
 bool 
 inode_resize(struct inode_disk *id, size_t size) 
 {
+  if (id->magic == EXTENT_MAGIC)
+    return extent_resize (id, size);
+
   size_t num_blocks = bytes_to_sectors (id -> length);
   size_t num_new_blocks = bytes_to_sectors (size);
   block_sector_t cur;
@@ -536,49 +486,82 @@ inode_resize(struct inode_disk *id, size_t size)
   return true;
 }
 
-/* Takes a sector number and writes size bytes of the buffer into the sector starting at the offset..
- * Writes the sector into the write-back buffer cache and writes to disk when evicted from the cache. */
-void
-write_sector(block_sector_t sector, void* buffer, off_t offset, size_t size)
+/* Grows or shrinks the extent-based inode ID to SIZE bytes.
+   Growth takes a run of sectors large enough for the whole
+   growth, extending the last extent in place when the sectors
+   after it are free, and falls back to smaller runs only when no
+   run that large is free.  New sectors are zeroed.  Returns
+   false, leaving ID unchanged, if the disk is full or ID has run
+   out of extents. */
+static bool
+extent_resize (struct inode_disk *id, off_t size)
 {
-    int i;
-    struct disk_block *block = NULL;
-    lock_acquire (&cache_lock);
-    
-    for (i = 0; i < 64; i++)
-      {
-        if (cache[i]->sector_id == sector) 
-          {
-            block = cache[i];
-            break;
-          }
-      }
+  static const uint8_t zeros[BLOCK_SECTOR_SIZE];
+  off_t old_length = id->length;
+  size_t have = bytes_to_sectors (id->length);
+  size_t want = bytes_to_sectors (size);
 
-    if (block != NULL)
-      {
-        lock_acquire (&block->block_lock);
-        cache_hits++;
-        lock_release (&cache_lock);
-        block->using = true;
-        block->dirty = true;
-        memcpy (block->data + offset, buffer, size);
-        lock_release (&block->block_lock);
-      }
-    else 
-      {
-        struct disk_block *to_replace = clock_algorithm ();
-        lock_acquire (&to_replace->block_lock);
-        to_replace->sector_id = sector;
-        memcpy (to_replace->data + offset, buffer, size);
-        to_replace->using = true;
-        to_replace->empty = false;
-        to_replace->dirty = true;
-        cache_misses++;
-        lock_release (&to_replace->block_lock);
-        lock_release (&cache_lock);
-      }
-}
+  while (have < want)
+    {
+      struct extent *last = (id->extent_cnt > 0
+                             ? &id->extents[id->extent_cnt - 1] : NULL);
+      size_t cnt = want - have;
+      block_sector_t start;
+      size_t i;
+
+      lock_acquire (&freemap_lock);
+      if (last != NULL
+          && free_map_allocate_at (last->start + last->length, cnt))
+        {
+          start = last->start + last->length;
+          last->length += cnt;
+        }
+      else
+        {
+          bool success = false;
+          if (id->extent_cnt < NUM_EXTENTS)
+            for (;;)
+              {
+                success = free_map_allocate (cnt, &start);
+                if (success || cnt == 1)
+                  break;
+                cnt /= 2;
+              }
+          if (!success)
+            {
+              lock_release (&freemap_lock);
+              id->length = have * BLOCK_SECTOR_SIZE;
+              extent_resize (id, old_length);
+              return false;
+            }
+          id->extents[id->extent_cnt].start = start;
+          id->extents[id->extent_cnt].length = cnt;
+          id->extent_cnt++;
+        }
+      lock_release (&freemap_lock);
+
+      for (i = 0; i < cnt; i++)
+        write_sector (start + i, zeros, 0, BLOCK_SECTOR_SIZE);
+      have += cnt;
+    }
 
+  while (have > want)
+    {
+      struct extent *last = &id->extents[id->extent_cnt - 1];
+      size_t cnt = have - want < last->length ? have - want : last->length;
+
+      lock_acquire (&freemap_lock);
+      free_map_release (last->start + last->length - cnt, cnt);
+      lock_release (&freemap_lock);
+      last->length -= cnt;
+      if (last->length == 0)
+        id->extent_cnt--;
+      have -= cnt;
+    }
+
+  id->length = size;
+  return true;
+}
 
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
@@ -595,13 +578,20 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
   if (inode->deny_write_cnt)
     return 0;
 
-  if (inode_length (inode) < offset + size) 
+  /* Grow the file, keeping the on-disk inode in step with the
+     in-memory copy.  If the file cannot grow, e.g. because the
+     disk is full, write only what fits in its current length. */
+  lock_acquire (&inode->lock);
+  if (inode->data.length < offset + size)
     {
-      struct inode_disk id;
-      read_sector (inode->sector, &id);
-      inode_resize (&id, offset + size);
-      write_sector (inode->sector, &id, 0, BLOCK_SECTOR_SIZE);
+      if (inode_resize (&inode->data, offset + size))
+        write_sector (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+      else if (offset >= inode->data.length)
+        size = 0;
+      else
+        size = inode->data.length - offset;
     }
+  lock_release (&inode->lock);
 
   while (size > 0)
     {
@@ -627,36 +617,6 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
   return bytes_written;
 }
 
-/* Explain what this does */
-struct disk_block *
-clock_algorithm (void)
-{
-  int found = false;
-  struct disk_block *temp;
-
-  while (!found)
-    {
-      temp = cache[clock_hand];
-      lock_acquire (&temp->block_lock);
-      clock_hand = (clock_hand + 1) % 64;
-      if (temp->empty || !temp->using)
-        found = true;
-      else
-        temp->using = false;
-      lock_release (&temp->block_lock);
-    }
-
-  if (temp->dirty)
-    {
-      lock_acquire (&temp->block_lock);
-      block_write (fs_device, temp->sector_id, temp->data);
-      lock_release (&temp->block_lock);
-    }
-
-  return temp;
-
-}
-
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 void
@@ -683,10 +643,19 @@ inode_allow_write (struct inode *inode)
 
 /* Returns the length, in bytes, of INODE's data. */
 off_t
-inode_length (const struct inode *inode)
+inode_length (struct inode *inode)
+{
+  off_t length;
+
+  lock_acquire (&inode->lock);
+  length = inode->data.length;
+  lock_release (&inode->lock);
+  return length;
+}
+
+/* Returns true if INODE is a directory. */
+bool
+inode_is_dir (struct inode *inode)
 {
-  struct inode_disk *data;
-  uint8_t buffer[BLOCK_SECTOR_SIZE];
-  data = read_sector (inode -> sector, buffer);
-  return data->length;
+  return inode->data.is_dir;
 }
@@ -8,30 +8,37 @@
 
 #define NUM_DIRECT_POINTERS 123
 #define NUM_BLOCK_POINTERS 128
+#define NUM_EXTENTS 62
 struct bitmap;
-int cache_hits;
-int cache_misses;
+
+/* A run of consecutive data sectors. */
+struct extent
+  {
+    block_sector_t start;               /* First sector. */
+    block_sector_t length;              /* Number of sectors. */
+  };
 
 /* On-disk inode.
-   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+   Must be exactly BLOCK_SECTOR_SIZE bytes long.
+   The magic number tells which layout the inode uses: direct,
+   indirect and doubly indirect block pointers, or a list of
+   extents. */
 struct inode_disk
   {
     off_t length;                       /* File size in bytes. */
     bool is_dir;
-    block_sector_t pointers[NUM_DIRECT_POINTERS + 2];
+    union
+      {
+        block_sector_t pointers[NUM_DIRECT_POINTERS + 2];
+        struct
+          {
+            uint32_t extent_cnt;        /* Number of extents in use. */
+            struct extent extents[NUM_EXTENTS];
+          };
+      };
     unsigned magic;                     /* Magic number. */
   };
 
-struct disk_block
-  {
-    struct lock block_lock;
-    block_sector_t sector_id;
-    char data[512];
-    bool using;
-    bool empty;
-    bool dirty;
-  };
-
 /* In-memory inode. */
 struct inode
   {
@@ -41,19 +48,19 @@ struct inode
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
     struct lock dw_lock;
+    struct lock lock;                   /* Protects data. */
+    struct inode_disk data;             /* Copy of the on-disk inode. */
+    off_t read_next;                    /* Where a sequential read would
+                                           continue. */
+    off_t readahead_end;                /* End of data already queued for
+                                           read-ahead. */
   };
 
-void cache_init (void);
-void cache_clear (void);
-struct disk_block *clock_algorithm (void);
-struct disk_block *cache[64];
-int clock_hand;
-struct lock cache_lock;
 struct lock freemap_lock;
 
-void *read_sector(block_sector_t sector, void *buffer);
-
 void inode_init (void);
+void inode_set_extents (bool);
+void inode_detect_layout (void);
 bool inode_create (block_sector_t, off_t, bool);
 struct inode *inode_open (block_sector_t);
 struct inode *inode_reopen (struct inode *);
@@ -64,6 +71,7 @@ off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
-off_t inode_length (const struct inode *);
+off_t inode_length (struct inode *);
+bool inode_is_dir (struct inode *);
 
 #endif /* filesys/inode.h */
@@ -0,0 +1,72 @@
+#ifndef __LIB_SYSCALL_IO_H
+#define __LIB_SYSCALL_IO_H
+
+/* Structures shared between user programs and the kernel by the
+   batched I/O system calls. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* One buffer of a readv() or writev() call. */
+struct iovec
+  {
+    void *iov_base;             /* Start of buffer. */
+    size_t iov_len;             /* Size of buffer in bytes. */
+  };
+
+/* Operations that can be queued on an I/O ring. */
+enum io_op
+  {
+    IO_OPEN,                    /* open (buf). */
+    IO_READ,                    /* read (fd, buf, len). */
+    IO_WRITE,                   /* write (fd, buf, len). */
+    IO_CLOSE                    /* close (fd); result is 0. */
+  };
+
+/* In a submission's FD, stands for the file descriptor returned
+   by the most recent successful IO_OPEN in the same io_enter()
+   call, or -1 if there is none, so that a file can be opened,
+   read and closed in one call. */
+#define IO_FD_PREV (-2)
+
+/* A submission queue entry: one operation for the kernel. */
+struct io_sqe
+  {
+    uint32_t op;                /* An enum io_op. */
+    int32_t fd;                 /* File descriptor or IO_FD_PREV. */
+    void *buf;                  /* Buffer, or file name for IO_OPEN. */
+    uint32_t len;               /* Size of BUF in bytes. */
+    uint32_t user_data;         /* Copied to the completion. */
+  };
+
+/* A completion queue entry: the result of one operation. */
+struct io_cqe
+  {
+    uint32_t user_data;         /* From the submission. */
+    int32_t result;             /* What the system call returned. */
+  };
+
+/* Number of entries in each queue of an I/O ring.  A power of 2. */
+#define IO_RING_ENTRIES 64
+
+/* A submission queue and a completion queue in user memory.
+
+   The program fills sq[sq_tail % IO_RING_ENTRIES] and advances
+   sq_tail for each operation, then calls io_enter().  The kernel
+   carries out operations from sq_head onward, in order, for as
+   long as the completion queue has room, posting each result at
+   cq[cq_tail % IO_RING_ENTRIES] and advancing sq_head and
+   cq_tail.  The program consumes completions from cq_head
+   onward.  The indexes only ever increase and wrap around
+   naturally.  A zeroed ring is empty. */
+struct io_ring
+  {
+    uint32_t sq_head;           /* Next submission for the kernel. */
+    uint32_t sq_tail;           /* Next free submission slot. */
+    uint32_t cq_head;           /* Next completion for the program. */
+    uint32_t cq_tail;           /* Next free completion slot. */
+    struct io_sqe sq[IO_RING_ENTRIES];
+    struct io_cqe cq[IO_RING_ENTRIES];
+  };
+
+#endif /* lib/syscall-io.h */
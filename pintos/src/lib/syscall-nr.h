@@ -34,7 +34,12 @@ enum
     SYS_CACHEM,
     SYS_BLOCKR,
     SYS_BLOCKW,
-    SYS_CACHECLEAR
+    SYS_CACHECLEAR,
+    SYS_CACHEP,                 /* Returns the read-ahead hit count. */
+    SYS_FORK,                   /* Duplicate this process. */
+    SYS_READV,                  /* Read into several buffers. */
+    SYS_WRITEV,                 /* Write from several buffers. */
+    SYS_IO_ENTER                /* Carry out queued I/O operations. */
   };
 
 #endif /* lib/syscall-nr.h */
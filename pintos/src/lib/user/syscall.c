@@ -87,6 +87,12 @@ exec (const char *file)
   return (pid_t) syscall1 (SYS_EXEC, file);
 }
 
+pid_t
+fork (void)
+{
+  return (pid_t) syscall0 (SYS_FORK);
+}
+
 int
 wait (pid_t pid)
 {
@@ -147,6 +153,24 @@ close (int fd)
   syscall1 (SYS_CLOSE, fd);
 }
 
+int
+readv (int fd, const struct iovec *iov, int iovcnt)
+{
+  return syscall3 (SYS_READV, fd, iov, iovcnt);
+}
+
+int
+writev (int fd, const struct iovec *iov, int iovcnt)
+{
+  return syscall3 (SYS_WRITEV, fd, iov, iovcnt);
+}
+
+int
+io_enter (struct io_ring *ring)
+{
+  return syscall1 (SYS_IO_ENTER, ring);
+}
+
 mapid_t
 mmap (int fd, void *addr)
 {
@@ -201,6 +225,12 @@ cachem (void)
   return syscall0 (SYS_CACHEM);
 }
 
+int
+cachep (void)
+{
+  return syscall0 (SYS_CACHEP);
+}
+
 unsigned long long
 blockr (void)
 {
@@ -3,6 +3,7 @@
 
 #include <stdbool.h>
 #include <debug.h>
+#include <syscall-io.h>
 
 /* Process identifier. */
 typedef int pid_t;
@@ -23,6 +24,7 @@ typedef int mapid_t;
 void halt (void) NO_RETURN;
 void exit (int status) NO_RETURN;
 pid_t exec (const char *file);
+pid_t fork (void);
 int wait (pid_t);
 bool create (const char *file, unsigned initial_size);
 bool remove (const char *file);
@@ -33,6 +35,9 @@ int write (int fd, const void *buffer, unsigned length);
 void seek (int fd, unsigned position);
 unsigned tell (int fd);
 void close (int fd);
+int readv (int fd, const struct iovec *, int iovcnt);
+int writev (int fd, const struct iovec *, int iovcnt);
+int io_enter (struct io_ring *);
 int practice (int i);
 
 /* Project 3 and optionally project 4. */
@@ -46,4 +51,12 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Buffer cache statistics, for testing. */
+int cacheh (void);
+int cachem (void);
+int cachep (void);
+unsigned long long blockr (void);
+unsigned long long blockw (void);
+void cacheclear (void);
+
 #endif /* lib/user/syscall.h */
@@ -0,0 +1,8 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+check_archive ({"child-cache-par" => "tests/filesys/extended/child-cache-par",
+		"shared" => [random_bytes (16 * 1024)]});
+pass;
@@ -0,0 +1,34 @@
+/* Writes a file and then has several processes read it back
+   over and over at the same time, to stress concurrent access
+   to the buffer cache.  Reports the cache hits and misses taken
+   while the children run. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/filesys/extended/cache-par.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[BUF_SIZE];
+
+void
+test_main (void)
+{
+  pid_t children[CHILD_CNT];
+  int hits, misses;
+  int fd;
+
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  random_bytes (buf, sizeof buf);
+  CHECK (write (fd, buf, sizeof buf) == (int) sizeof buf,
+         "write %zu bytes to \"%s\"", sizeof buf, file_name);
+  close (fd);
+
+  hits = cacheh ();
+  misses = cachem ();
+  exec_children ("child-cache-par", children, CHILD_CNT);
+  wait_children (children, CHILD_CNT);
+  msg ("read phase: %d hits, %d misses",
+       cacheh () - hits, cachem () - misses);
+}
@@ -0,0 +1,37 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+
+# The read phase's hit and miss counts vary from run to run, so
+# take them out before comparing the rest of the output.
+my ($hits, $misses) = map (/read phase: (\d+) hits, (\d+) misses/, @output);
+fail "No read phase statistics found in output.\n" if !defined $misses;
+@output = grep (!/read phase:/, @output);
+
+compare_output ("run", IGNORE_EXIT_CODES => 1, \@output, [<<'EOF']);
+(cache-par) begin
+(cache-par) create "shared"
+(cache-par) open "shared"
+(cache-par) write 16384 bytes to "shared"
+(cache-par) exec child 1 of 4: "child-cache-par 0"
+(cache-par) exec child 2 of 4: "child-cache-par 1"
+(cache-par) exec child 3 of 4: "child-cache-par 2"
+(cache-par) exec child 4 of 4: "child-cache-par 3"
+(cache-par) wait for child 1 of 4 returned 0 (expected 0)
+(cache-par) wait for child 2 of 4 returned 1 (expected 1)
+(cache-par) wait for child 3 of 4 returned 2 (expected 2)
+(cache-par) wait for child 4 of 4 returned 3 (expected 3)
+(cache-par) end
+EOF
+
+# Report the hit rate over the phase in which 4 children each
+# read the 16 kB file 16 times.
+my ($total) = $hits + $misses;
+pass sprintf ("read phase: %d hits, %d misses (%.1f%% hits)",
+	      $hits, $misses, $total > 0 ? 100 * $hits / $total : 0);
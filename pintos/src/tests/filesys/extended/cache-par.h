@@ -0,0 +1,9 @@
+#ifndef TESTS_FILESYS_EXTENDED_CACHE_PAR_H
+#define TESTS_FILESYS_EXTENDED_CACHE_PAR_H
+
+#define CHILD_CNT 4
+#define ITER_CNT 16
+#define BUF_SIZE (16 * 1024)
+static const char file_name[] = "shared";
+
+#endif /* tests/filesys/extended/cache-par.h */
@@ -0,0 +1,42 @@
+/* Child process for cache-par.
+   Reads the file written by our parent process ITER_CNT times,
+   checking its contents each time. */
+
+#include <random.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "tests/filesys/extended/cache-par.h"
+#include "tests/lib.h"
+
+const char *test_name = "child-cache-par";
+
+static char buf1[BUF_SIZE];
+static char buf2[BUF_SIZE];
+
+int
+main (int argc, const char *argv[])
+{
+  int child_idx;
+  int fd;
+  int i;
+
+  quiet = true;
+
+  CHECK (argc == 2, "argc must be 2, actually %d", argc);
+  child_idx = atoi (argv[1]);
+
+  random_init (0);
+  random_bytes (buf1, sizeof buf1);
+
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  for (i = 0; i < ITER_CNT; i++)
+    {
+      seek (fd, 0);
+      CHECK (read (fd, buf2, sizeof buf2) == (int) sizeof buf2,
+             "read %zu bytes from \"%s\"", sizeof buf2, file_name);
+      compare_bytes (buf2, buf1, sizeof buf2, 0, file_name);
+    }
+  close (fd);
+
+  return child_idx;
+}
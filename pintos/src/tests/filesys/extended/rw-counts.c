@@ -15,6 +15,6 @@ test_main (void)
   close(fd);
 
   int reads = blockr();
-  msg("There should only be one inode metadata read: %d, expected 1", reads - initial);
+  msg("There should be no inode metadata reads: %d, expected 0", reads - initial);
 
 }
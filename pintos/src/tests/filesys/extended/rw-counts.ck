@@ -6,7 +6,7 @@ use tests::random;
 check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
 (rw-counts) begin
 (rw-counts) open "empty-file.txt"
-(rw-counts) There should only be one inode metadata read: 1, expected 1
+(rw-counts) There should be no inode metadata reads: 0, expected 0
 (rw-counts) end
 EOF
 pass;
@@ -0,0 +1,51 @@
+/* Forks a child that checks that it sees its parent's data,
+   then overwrites it, and verifies that the parent's copy is
+   unchanged. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (4 * 4096)
+
+static char buf[SIZE];
+
+/* Returns true if every byte of BUF is C. */
+static bool
+all_equal (char c)
+{
+  size_t i;
+
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != c)
+      return false;
+  return true;
+}
+
+void
+test_main (void)
+{
+  pid_t child;
+  int status;
+
+  memset (buf, 'a', SIZE);
+  child = fork ();
+  if (child == 0)
+    {
+      if (!all_equal ('a'))
+        fail ("child read bad data");
+      msg ("child sees parent's data");
+      memset (buf, 'b', SIZE);
+      if (!all_equal ('b'))
+        fail ("child's write was lost");
+      msg ("child wrote its own copy");
+      exit (81);
+    }
+  if (child < 0)
+    fail ("fork failed");
+
+  status = wait (child);
+  CHECK (status == 81, "wait for child");
+  CHECK (all_equal ('a'), "checking that parent's data is unchanged");
+}
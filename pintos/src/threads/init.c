@@ -1,9 +1,11 @@
 #include "threads/init.h"
 #include <console.h>
+#include <ctype.h>
 #include <debug.h>
 #include <inttypes.h>
 #include <limits.h>
 #include <random.h>
+#include <round.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -34,8 +36,15 @@
 #ifdef FILESYS
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/page.h"
+#include "vm/pagecache.h"
+#include "vm/swap.h"
+#endif
 #endif
 
 /* Page directory with kernel mappings only. */
@@ -45,6 +54,9 @@ uint32_t *init_page_dir;
 /* -f: Format the file system? */
 static bool format_filesys;
 
+/* -extents: Format with extent-based inodes? */
+static bool format_extents;
+
 /* -filesys, -scratch, -swap: Names of block devices to use,
    overriding the defaults. */
 static const char *filesys_bdev_name;
@@ -52,6 +64,12 @@ static const char *scratch_bdev_name;
 #ifdef VM
 static const char *swap_bdev_name;
 #endif
+
+/* -cache: Maximum number of sectors in the buffer cache. */
+static size_t cache_sectors = CACHE_DEFAULT_SECTORS;
+
+/* -dirty: Percentage of the buffer cache that may be dirty. */
+static int cache_dirty_pct = CACHE_DEFAULT_DIRTY_PCT;
 #endif /* FILESYS */
 
 /* -ul: Maximum number of pages to put into palloc's user pool. */
@@ -62,6 +80,9 @@ static void paging_init (void);
 
 static char **read_command_line (void);
 static char **parse_options (char **argv);
+static int parse_int_option (const char *name, const char *value,
+                             int min, int max);
+static void parse_time_slices (char *value);
 static void run_actions (char **argv);
 static void usage (void);
 
@@ -124,7 +145,15 @@ main (void)
   /* Initialize file system. */
   ide_init ();
   locate_block_devices ();
-  filesys_init (format_filesys);
+  cache_init (cache_sectors, cache_dirty_pct);
+  filesys_init (format_filesys, format_extents);
+#endif
+
+#ifdef VM
+  /* Initialize virtual memory. */
+  frame_init ();
+  swap_init ();
+  pagecache_init ();
 #endif
 
   printf ("Boot complete.\n");
@@ -243,19 +272,35 @@ parse_options (char **argv)
 #ifdef FILESYS
       else if (!strcmp (name, "-f"))
         format_filesys = true;
+      else if (!strcmp (name, "-extents"))
+        format_extents = true;
       else if (!strcmp (name, "-filesys"))
         filesys_bdev_name = value;
       else if (!strcmp (name, "-scratch"))
         scratch_bdev_name = value;
+      else if (!strcmp (name, "-cache"))
+        cache_sectors = parse_int_option (name, value, 1, 65536);
+      else if (!strcmp (name, "-dirty"))
+        cache_dirty_pct = parse_int_option (name, value, 1, 100);
 #ifdef VM
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
+      else if (!strcmp (name, "-stack"))
+        {
+          size_t kb = parse_int_option (name, value, 1,
+                                        STACK_MAX_LIMIT / 1024);
+          page_stack_limit = ROUND_UP (kb * 1024, PGSIZE);
+        }
 #endif
 #endif
       else if (!strcmp (name, "-rs"))
         random_init (atoi (value));
       else if (!strcmp (name, "-mlfqs"))
         thread_mlfqs = true;
+      else if (!strcmp (name, "-tickless"))
+        timer_tickless = true;
+      else if (!strcmp (name, "-slice"))
+        parse_time_slices (value);
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
@@ -277,6 +322,49 @@ parse_options (char **argv)
   return argv;
 }
 
+/* Returns VALUE, the argument to option NAME, as an integer.
+   Panics unless VALUE is a decimal number between MIN and MAX,
+   inclusive, where MIN is not negative. */
+static int
+parse_int_option (const char *name, const char *value, int min, int max)
+{
+  const char *p;
+  int n = 0;
+
+  ASSERT (min >= 0 && min <= max && max <= INT_MAX / 10);
+
+  if (value == NULL || *value == '\0')
+    PANIC ("%s requires an argument (use -h for help)", name);
+  for (p = value; *p != '\0'; p++)
+    if (!isdigit (*p) || (n = n * 10 + (*p - '0')) > max)
+      break;
+  if (*p != '\0' || n < min)
+    PANIC ("%s must be between %d and %d (use -h for help)", name, min, max);
+  return n;
+}
+
+/* Parses VALUE, the argument to -slice, as up to PRI_CLASS_CNT
+   comma-separated time slices of 1 to 1000 ticks, for the low,
+   normal and high priority classes in that order. */
+static void
+parse_time_slices (char *value)
+{
+  char *token, *save_ptr;
+  int class = PRI_CLASS_LOW;
+
+  if (value == NULL)
+    PANIC ("-slice requires an argument (use -h for help)");
+  for (token = strtok_r (value, ",", &save_ptr); token != NULL;
+       token = strtok_r (NULL, ",", &save_ptr))
+    {
+      if (class >= PRI_CLASS_CNT)
+        PANIC ("-slice takes at most %d values (use -h for help)",
+               PRI_CLASS_CNT);
+      thread_time_slice[class++] = parse_int_option ("-slice", token,
+                                                     1, 1000);
+    }
+}
+
 /* Runs the task specified in ARGV[1]. */
 static void
 run_task (char **argv)
@@ -315,6 +403,7 @@ run_actions (char **argv)
       {"rm", 2, fsutil_rm},
       {"extract", 1, fsutil_extract},
       {"append", 2, fsutil_append},
+      {"cache-bench", 1, fsutil_cache_bench},
 #endif
       {NULL, 0, NULL},
     };
@@ -361,6 +450,7 @@ usage (void)
           "  ls                 List files in the root directory.\n"
           "  cat FILE           Print FILE to the console.\n"
           "  rm FILE            Delete FILE.\n"
+          "  cache-bench        Time buffer cache lookups.\n"
           "Use these actions indirectly via `pintos' -g and -p options:\n"
           "  extract            Untar from scratch device into file system.\n"
           "  append FILE        Append FILE to tar file on scratch device.\n"
@@ -371,14 +461,21 @@ usage (void)
           "  -r                 Reboot after actions.\n"
 #ifdef FILESYS
           "  -f                 Format file system device during startup.\n"
+          "  -extents           Use extent-based inodes when formatting.\n"
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+          "  -cache=N           Let the buffer cache grow to N sectors.\n"
+          "  -dirty=PCT         Throttle writers above PCT%% dirty sectors.\n"
 #ifdef VM
           "  -swap=BDEV         Use BDEV for swap instead of default.\n"
+          "  -stack=KB          Let user stacks grow to KB kB.\n"
 #endif
 #endif
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+          "  -tickless          Stop the timer interrupt while idle.\n"
+          "  -slice=L,N,H       Give threads of low, normal and high priority\n"
+          "                     time slices of L, N and H ticks.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
 #endif
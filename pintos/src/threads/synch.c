@@ -32,6 +32,14 @@
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 
+/* Most locks a priority donation is passed along, e.g. from a
+   thread to the holder of the lock it wants, to the holder of
+   the lock that holder wants, and so on. */
+#define DONATION_DEPTH 8
+
+static struct thread *max_priority_waiter (struct list *waiters);
+static void donate_priority (struct thread *);
+
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
    manipulating it:
@@ -101,8 +109,27 @@ sema_try_down (struct semaphore *sema)
   return success;
 }
 
+/* Returns the highest-priority thread in WAITERS, a non-empty
+   list of threads linked through their `elem' members.  Of
+   threads with equal priority, the one waiting longest wins. */
+static struct thread *
+max_priority_waiter (struct list *waiters)
+{
+  struct thread *max = NULL;
+  struct list_elem *e;
+
+  for (e = list_begin (waiters); e != list_end (waiters); e = list_next (e))
+    {
+      struct thread *t = list_entry (e, struct thread, elem);
+      if (max == NULL || t->priority > max->priority)
+        max = t;
+    }
+  return max;
+}
+
 /* Up or "V" operation on a semaphore.  Increments SEMA's value
-   and wakes up one thread of those waiting for SEMA, if any.
+   and wakes up the highest-priority thread of those waiting for
+   SEMA, if any.
 
    This function may be called from an interrupt handler. */
 void
@@ -114,10 +141,14 @@ sema_up (struct semaphore *sema)
 
   old_level = intr_disable ();
   if (!list_empty (&sema->waiters))
-    thread_unblock (list_entry (list_pop_front (&sema->waiters),
-                                struct thread, elem));
+    {
+      struct thread *t = max_priority_waiter (&sema->waiters);
+      list_remove (&t->elem);
+      thread_unblock (t);
+    }
   sema->value++;
   intr_set_level (old_level);
+  thread_preempt ();
 }
 
 static void sema_test_helper (void *sema_);
@@ -181,9 +212,33 @@ lock_init (struct lock *lock)
   sema_init (&lock->semaphore, 1);
 }
 
+/* Raises the priority of the thread holding the lock T waits
+   for to T's priority, and so on along the chain of holders
+   waiting for other locks, up to DONATION_DEPTH locks.
+   Interrupts must be off. */
+static void
+donate_priority (struct thread *t)
+{
+  struct lock *lock = t->waiting_on;
+  int depth;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (depth = 0; lock != NULL && depth < DONATION_DEPTH; depth++)
+    {
+      struct thread *holder = lock->holder;
+
+      if (holder == NULL || holder->priority >= t->priority)
+        break;
+      thread_set_effective_priority (holder, t->priority);
+      lock = holder->waiting_on;
+    }
+}
+
 /* Acquires LOCK, sleeping until it becomes available if
    necessary.  The lock must not already be held by the current
-   thread.
+   thread.  While waiting, the current thread donates its
+   priority to the holder.
 
    This function may sleep, so it must not be called within an
    interrupt handler.  This function may be called with
@@ -192,12 +247,24 @@ lock_init (struct lock *lock)
 void
 lock_acquire (struct lock *lock)
 {
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
   ASSERT (!lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
+  if (lock->holder != NULL && !thread_mlfqs)
+    {
+      cur->waiting_on = lock;
+      donate_priority (cur);
+    }
   sema_down (&lock->semaphore);
-  lock->holder = thread_current ();
+  cur->waiting_on = NULL;
+  lock->holder = cur;
+  list_push_back (&cur->locks, &lock->elem);
+  intr_set_level (old_level);
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -209,18 +276,26 @@ lock_acquire (struct lock *lock)
 bool
 lock_try_acquire (struct lock *lock)
 {
+  enum intr_level old_level;
   bool success;
 
   ASSERT (lock != NULL);
   ASSERT (!lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
   success = sema_try_down (&lock->semaphore);
   if (success)
-    lock->holder = thread_current ();
+    {
+      lock->holder = thread_current ();
+      list_push_back (&thread_current ()->locks, &lock->elem);
+    }
+  intr_set_level (old_level);
   return success;
 }
 
 /* Releases LOCK, which must be owned by the current thread.
+   Gives up any priority donated through LOCK, and yields if that
+   leaves a ready thread with a higher priority.
 
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to release a lock within an interrupt
@@ -228,11 +303,19 @@ lock_try_acquire (struct lock *lock)
 void
 lock_release (struct lock *lock)
 {
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
   ASSERT (lock != NULL);
   ASSERT (lock_held_by_current_thread (lock));
 
+  old_level = intr_disable ();
+  list_remove (&lock->elem);
   lock->holder = NULL;
+  thread_refresh_priority (cur);
   sema_up (&lock->semaphore);
+  intr_set_level (old_level);
+  thread_preempt ();
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -251,6 +334,7 @@ struct semaphore_elem
   {
     struct list_elem elem;              /* List element. */
     struct semaphore semaphore;         /* This semaphore. */
+    struct thread *thread;              /* Thread waiting on it. */
   };
 
 /* Initializes condition variable COND.  A condition variable
@@ -295,6 +379,7 @@ cond_wait (struct condition *cond, struct lock *lock)
   ASSERT (lock_held_by_current_thread (lock));
 
   sema_init (&waiter.semaphore, 0);
+  waiter.thread = thread_current ();
   list_push_back (&cond->waiters, &waiter.elem);
   lock_release (lock);
   sema_down (&waiter.semaphore);
@@ -302,8 +387,8 @@ cond_wait (struct condition *cond, struct lock *lock)
 }
 
 /* If any threads are waiting on COND (protected by LOCK), then
-   this function signals one of them to wake up from its wait.
-   LOCK must be held before calling this function.
+   this function signals the highest-priority one to wake up from
+   its wait.  LOCK must be held before calling this function.
 
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to signal a condition variable within an
@@ -317,8 +402,21 @@ cond_signal (struct condition *cond, struct lock *lock UNUSED)
   ASSERT (lock_held_by_current_thread (lock));
 
   if (!list_empty (&cond->waiters))
-    sema_up (&list_entry (list_pop_front (&cond->waiters),
-                          struct semaphore_elem, elem)->semaphore);
+    {
+      struct semaphore_elem *max = NULL;
+      struct list_elem *e;
+
+      for (e = list_begin (&cond->waiters); e != list_end (&cond->waiters);
+           e = list_next (e))
+        {
+          struct semaphore_elem *s
+            = list_entry (e, struct semaphore_elem, elem);
+          if (max == NULL || s->thread->priority > max->thread->priority)
+            max = s;
+        }
+      list_remove (&max->elem);
+      sema_up (&max->semaphore);
+    }
 }
 
 /* Wakes up all threads, if any, waiting on COND (protected by
@@ -11,18 +11,28 @@
 #include "threads/switch.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
+#include "devices/ide.h"
+#include "devices/timer.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #endif
+#ifdef FILESYS
+#include "filesys/directory.h"
+#endif
 
 /* Random value for struct thread's `magic' member.
    Used to detect stack overflow.  See the big comment at the top
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+/* Processes in THREAD_READY state, that is, processes that are
+   ready to run but not actually running, with one FIFO queue per
+   priority.  Bit P of ready_mask (word P / 32, bit P % 32) is set
+   exactly when ready_queues[P] is non-empty, so the highest ready
+   priority is found with one find-first-set per word. */
+static struct list ready_queues[PRI_MAX + 1];
+static uint32_t ready_mask[(PRI_MAX + 32) / 32];
+static int ready_cnt;           /* Number of threads in ready_queues. */
 
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
@@ -51,19 +61,37 @@ static long long kernel_ticks;  /* # of timer ticks in kernel threads. */
 static long long user_ticks;    /* # of timer ticks in user programs. */
 
 /* Scheduling. */
-#define TIME_SLICE 4            /* # of timer ticks to give each thread. */
+#define TIME_SLICE 4            /* Default # of timer ticks per thread. */
 static unsigned thread_ticks;   /* # of timer ticks since last yield. */
+unsigned thread_time_slice[PRI_CLASS_CNT] = { TIME_SLICE, TIME_SLICE,
+                                              TIME_SLICE };
+
+/* # of timer ticks between recomputations of the running thread's
+   priority under the multi-level feedback queue scheduler. */
+#define MLFQS_PRIORITY_TICKS 4
 
 /* If false (default), use round-robin scheduler.
    If true, use multi-level feedback queue scheduler.
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* Estimated number of threads ready to run over the past minute,
+   for the multi-level feedback queue scheduler. */
+static fixed_point_t load_avg;
+
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
 static struct thread *running_thread (void);
 static struct thread *next_thread_to_run (void);
+static void ready_insert (struct thread *);
+static void ready_remove (struct thread *);
+static int ready_max_priority (void);
+static unsigned time_slice (const struct thread *);
+static int mlfqs_priority (const struct thread *);
+static void mlfqs_tick (struct thread *);
+static void mlfqs_decay_recent_cpu (struct thread *, void *coefficient);
+static void mlfqs_reprioritize_ready (void);
 static void init_thread (struct thread *, const char *name, int priority);
 static bool is_thread (struct thread *) UNUSED;
 static void *alloc_frame (struct thread *, size_t size);
@@ -87,10 +115,13 @@ static tid_t allocate_tid (void);
 void
 thread_init (void)
 {
+  int i;
+
   ASSERT (intr_get_level () == INTR_OFF);
 
   lock_init (&tid_lock);
-  list_init (&ready_list);
+  for (i = 0; i <= PRI_MAX; i++)
+    list_init (&ready_queues[i]);
   list_init (&all_list);
 
   /* Set up a thread structure for the running thread. */
@@ -134,17 +165,44 @@ thread_tick (void)
   else
     kernel_ticks++;
 
+  if (thread_mlfqs)
+    mlfqs_tick (t);
+
   /* Enforce preemption. */
-  if (++thread_ticks >= TIME_SLICE)
+  if (++thread_ticks >= time_slice (t))
     intr_yield_on_return ();
 }
 
+/* Called by the timer with CNT timer ticks that passed while the
+   idle thread ran without timer interrupts. */
+void
+thread_idle_ticks (int64_t cnt)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  idle_ticks += cnt;
+}
+
+/* Returns the time slice of T's priority class, in timer ticks. */
+static unsigned
+time_slice (const struct thread *t)
+{
+  if (t->priority < 16)
+    return thread_time_slice[PRI_CLASS_LOW];
+  else if (t->priority < 48)
+    return thread_time_slice[PRI_CLASS_NORMAL];
+  else
+    return thread_time_slice[PRI_CLASS_HIGH];
+}
+
 /* Prints thread statistics. */
 void
 thread_print_stats (void)
 {
   printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
           idle_ticks, kernel_ticks, user_ticks);
+  printf ("Thread: %llu CPU cycles per MB read from disk\n",
+          ide_read_cycles_per_mb ());
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -159,9 +217,8 @@ thread_print_stats (void)
    scheduled.  Use a semaphore or some other form of
    synchronization if you need to ensure ordering.
 
-   The code provided sets the new thread's `priority' member to
-   PRIORITY, but no actual priority scheduling is implemented.
-   Priority scheduling is the goal of Problem 1-3. */
+   The new thread preempts the caller at once if PRIORITY is
+   higher than the caller's and interrupts are on. */
 tid_t
 thread_create (const char *name, int priority,
                thread_func *function, void *aux)
@@ -198,8 +255,9 @@ thread_create (const char *name, int priority,
   sf->eip = switch_entry;
   sf->ebp = 0;
 
-  /* Add to run queue. */
+  /* Add to run queue, and run it now if it outranks us. */
   thread_unblock (t);
+  thread_preempt ();
 
   return tid;
 }
@@ -227,7 +285,10 @@ thread_block (void)
    This function does not preempt the running thread.  This can
    be important: if the caller had disabled interrupts itself,
    it may expect that it can atomically unblock a thread and
-   update other data. */
+   update other data.  Callers that can afford to switch should
+   call thread_preempt() afterward.  From an interrupt handler,
+   unblocking a thread that outranks the running one yields on
+   return from the interrupt. */
 void
 thread_unblock (struct thread *t)
 {
@@ -237,11 +298,38 @@ thread_unblock (struct thread *t)
 
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
-  list_push_back (&ready_list, &t->elem);
+  if (thread_mlfqs)
+    t->priority = mlfqs_priority (t);
+  ready_insert (t);
   t->status = THREAD_READY;
+  if (intr_context () && t->priority > running_thread ()->priority)
+    intr_yield_on_return ();
   intr_set_level (old_level);
 }
 
+/* Yields the CPU if a ready thread has a higher priority than
+   the running thread.  In an interrupt handler the yield happens
+   on return from the interrupt.  Does nothing if interrupts are
+   off, so that a caller that disabled them keeps running until
+   it turns them back on and reaches the next preemption point. */
+void
+thread_preempt (void)
+{
+  enum intr_level old_level;
+  bool outranked;
+
+  old_level = intr_disable ();
+  outranked = ready_max_priority () > running_thread ()->priority;
+  intr_set_level (old_level);
+
+  if (!outranked)
+    return;
+  if (intr_context ())
+    intr_yield_on_return ();
+  else if (old_level == INTR_ON)
+    thread_yield ();
+}
+
 /* Returns the name of the running thread. */
 const char *
 thread_name (void)
@@ -308,7 +396,7 @@ thread_yield (void)
 
   old_level = intr_disable ();
   if (cur != idle_thread)
-    list_push_back (&ready_list, &cur->elem);
+    ready_insert (cur);
   cur->status = THREAD_READY;
   schedule ();
   intr_set_level (old_level);
@@ -331,11 +419,80 @@ thread_foreach (thread_action_func *func, void *aux)
     }
 }
 
-/* Sets the current thread's priority to NEW_PRIORITY. */
+/* Sets the current thread's base priority to NEW_PRIORITY,
+   yielding if that leaves a ready thread with a higher priority.
+   A priority donated to the thread through a lock it holds stays
+   in effect until the lock is released.  Under the multi-level
+   feedback queue scheduler, priorities are computed by the
+   scheduler and this function does nothing. */
 void
 thread_set_priority (int new_priority)
 {
-  thread_current ()->priority = new_priority;
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (PRI_MIN <= new_priority && new_priority <= PRI_MAX);
+
+  if (thread_mlfqs)
+    return;
+
+  old_level = intr_disable ();
+  cur->base_priority = new_priority;
+  thread_refresh_priority (cur);
+  intr_set_level (old_level);
+  thread_preempt ();
+}
+
+/* Sets T's effective priority to PRIORITY, moving T to the
+   matching run queue if it is ready.  Does not preempt.
+   Interrupts must be off. */
+void
+thread_set_effective_priority (struct thread *t, int priority)
+{
+  ASSERT (is_thread (t));
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
+
+  if (t->status == THREAD_READY)
+    {
+      ready_remove (t);
+      t->priority = priority;
+      ready_insert (t);
+    }
+  else
+    t->priority = priority;
+}
+
+/* Recomputes T's effective priority as the highest of its base
+   priority and the priorities of the threads waiting for locks
+   it holds.  Interrupts must be off.  Does nothing under the
+   multi-level feedback queue scheduler, which does not donate. */
+void
+thread_refresh_priority (struct thread *t)
+{
+  int priority = t->base_priority;
+  struct list_elem *l, *w;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (thread_mlfqs)
+    return;
+
+  for (l = list_begin (&t->locks); l != list_end (&t->locks);
+       l = list_next (l))
+    {
+      struct list *waiters
+        = &list_entry (l, struct lock, elem)->semaphore.waiters;
+
+      for (w = list_begin (waiters); w != list_end (waiters);
+           w = list_next (w))
+        {
+          struct thread *waiter = list_entry (w, struct thread, elem);
+          if (waiter->priority > priority)
+            priority = waiter->priority;
+        }
+    }
+  thread_set_effective_priority (t, priority);
 }
 
 /* Returns the current thread's priority. */
@@ -345,35 +502,143 @@ thread_get_priority (void)
   return thread_current ()->priority;
 }
 
-/* Sets the current thread's nice value to NICE. */
+/* Sets the current thread's nice value to NICE and recomputes
+   its priority, yielding if it no longer has the highest. */
 void
-thread_set_nice (int nice UNUSED)
+thread_set_nice (int nice)
 {
-  /* Not yet implemented. */
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (NICE_MIN <= nice && nice <= NICE_MAX);
+
+  old_level = intr_disable ();
+  cur->nice = nice;
+  if (thread_mlfqs)
+    cur->priority = mlfqs_priority (cur);
+  intr_set_level (old_level);
+  thread_preempt ();
 }
 
 /* Returns the current thread's nice value. */
 int
 thread_get_nice (void)
 {
-  /* Not yet implemented. */
-  return 0;
+  return thread_current ()->nice;
 }
 
 /* Returns 100 times the system load average. */
 int
 thread_get_load_avg (void)
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int load_avg_100 = fix_round (fix_scale (load_avg, 100));
+  intr_set_level (old_level);
+  return load_avg_100;
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
 int
 thread_get_recent_cpu (void)
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int recent_cpu_100
+    = fix_round (fix_scale (thread_current ()->recent_cpu, 100));
+  intr_set_level (old_level);
+  return recent_cpu_100;
+}
+
+/* Returns the priority the multi-level feedback queue scheduler
+   gives T, based on its recent CPU use and nice value. */
+static int
+mlfqs_priority (const struct thread *t)
+{
+  int priority = (PRI_MAX - fix_trunc (fix_unscale (t->recent_cpu, 4))
+                  - t->nice * 2);
+
+  if (priority < PRI_MIN)
+    return PRI_MIN;
+  if (priority > PRI_MAX)
+    return PRI_MAX;
+  return priority;
+}
+
+/* Does the multi-level feedback queue scheduler's work for one
+   timer tick, in which CUR was running.
+
+   Between the once-a-second updates only the running thread's
+   recent_cpu changes, so every fourth tick only its priority is
+   recomputed.  Blocked threads get a fresh priority when they
+   are unblocked, so the once-a-second priority pass need only
+   visit the ready threads. */
+static void
+mlfqs_tick (struct thread *cur)
+{
+  int64_t ticks = timer_ticks ();
+
+  ASSERT (intr_context ());
+
+  if (cur != idle_thread)
+    cur->recent_cpu = fix_add (cur->recent_cpu, fix_int (1));
+
+  if (ticks % TIMER_FREQ == 0)
+    {
+      int ready_threads = ready_cnt + (cur != idle_thread);
+      fixed_point_t twice_load, coefficient;
+
+      load_avg = fix_add (fix_mul (fix_frac (59, 60), load_avg),
+                          fix_frac (ready_threads, 60));
+      twice_load = fix_scale (load_avg, 2);
+      coefficient = fix_div (twice_load, fix_add (twice_load, fix_int (1)));
+      thread_foreach (mlfqs_decay_recent_cpu, &coefficient);
+      mlfqs_reprioritize_ready ();
+    }
+
+  if (ticks % MLFQS_PRIORITY_TICKS == 0 && cur != idle_thread)
+    {
+      cur->priority = mlfqs_priority (cur);
+      if (ready_max_priority () > cur->priority)
+        intr_yield_on_return ();
+    }
+}
+
+/* Decays T's recent_cpu by COEFFICIENT_, a fixed_point_t
+   computed from the load average.  Used with thread_foreach()
+   once a second. */
+static void
+mlfqs_decay_recent_cpu (struct thread *t, void *coefficient_)
+{
+  fixed_point_t *coefficient = coefficient_;
+
+  if (t == idle_thread)
+    return;
+  t->recent_cpu = fix_add (fix_mul (*coefficient, t->recent_cpu),
+                           fix_int (t->nice));
+}
+
+/* Recomputes the priority of every ready thread, moving each one
+   whose priority changed to its new run queue.  A thread moved
+   to a queue that is visited later is recomputed again, which is
+   harmless because the result does not change. */
+static void
+mlfqs_reprioritize_ready (void)
+{
+  int pri;
+
+  for (pri = PRI_MIN; pri <= PRI_MAX; pri++)
+    {
+      struct list_elem *e = list_begin (&ready_queues[pri]);
+
+      while (e != list_end (&ready_queues[pri]))
+        {
+          struct thread *t = list_entry (e, struct thread, elem);
+          int priority = mlfqs_priority (t);
+
+          e = list_next (e);
+          if (priority != t->priority)
+            thread_set_effective_priority (t, priority);
+        }
+    }
 }
 
 /* Idle thread.  Executes when no other thread is ready to run.
@@ -398,6 +663,10 @@ idle (void *idle_started_ UNUSED)
       intr_disable ();
       thread_block ();
 
+      /* Nobody else is ready.  In tickless mode, stop the
+         periodic timer interrupt until the next sleeper is due. */
+      timer_idle_enter ();
+
       /* Re-enable interrupts and wait for the next one.
 
          The `sti' instruction disables interrupts until the
@@ -462,17 +731,31 @@ init_thread (struct thread *t, const char *name, int priority)
   strlcpy (t->name, name, sizeof t->name);
   t->stack = (uint8_t *) t + PGSIZE;
   t->priority = priority;
+  t->base_priority = priority;
+  list_init (&t->locks);
+
+  /* Inherit the creating thread's niceness and recent CPU use. */
+  if (t != running_thread ())
+    {
+      t->nice = running_thread ()->nice;
+      t->recent_cpu = running_thread ()->recent_cpu;
+    }
+  if (thread_mlfqs)
+    t->priority = mlfqs_priority (t);
 
-  // Initialize array of file descriptors to be empty
-  // except for 0 and 1, which are stdin/stdout
-  memset (t->files, 0, 130 * sizeof (struct wrapper *));
-  t->files[0] = 1;
-  t->files[1] = 1;
+#ifdef USERPROG
+  fd_table_init (&t->fds);
+#endif
 
   list_init (&t->child_process_structs);
   sema_init (&t->wait_sema, 0);
   sema_init (&t->load_sema, 0);
+#ifdef VM
+  list_init (&t->mappings);
+  t->next_mapid = 0;
+#endif
 
+#ifdef FILESYS
   if (strcmp(name, "main") == 0 || strcmp(name, "idle") == 0)
     t->cwd = NULL;
   else
@@ -482,6 +765,7 @@ init_thread (struct thread *t, const char *name, int priority)
       else
         t->cwd = dir_reopen (thread_current ()->cwd);
     }
+#endif
 
   t->has_parent = false;
   t->cpi = NULL;
@@ -510,15 +794,63 @@ alloc_frame (struct thread *t, size_t size)
 /* Chooses and returns the next thread to be scheduled.  Should
    return a thread from the run queue, unless the run queue is
    empty.  (If the running thread can continue running, then it
-   will be in the run queue.)  If the run queue is empty, return
-   idle_thread. */
+   will be in the run queue.)  Threads of equal priority run in
+   FIFO order.  If the run queue is empty, return idle_thread. */
 static struct thread *
 next_thread_to_run (void)
 {
-  if (list_empty (&ready_list))
+  int pri = ready_max_priority ();
+  struct list *queue;
+  struct thread *t;
+
+  if (pri < 0)
     return idle_thread;
-  else
-    return list_entry (list_pop_front (&ready_list), struct thread, elem);
+
+  queue = &ready_queues[pri];
+  t = list_entry (list_front (queue), struct thread, elem);
+  ready_remove (t);
+  return t;
+}
+
+/* Appends T to the run queue for its priority.  Interrupts must
+   be off. */
+static void
+ready_insert (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (PRI_MIN <= t->priority && t->priority <= PRI_MAX);
+
+  list_push_back (&ready_queues[t->priority], &t->elem);
+  ready_mask[t->priority / 32] |= 1u << (t->priority % 32);
+  ready_cnt++;
+}
+
+/* Removes ready thread T from its run queue.  Interrupts must be
+   off. */
+static void
+ready_remove (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  list_remove (&t->elem);
+  if (list_empty (&ready_queues[t->priority]))
+    ready_mask[t->priority / 32] &= ~(1u << (t->priority % 32));
+  ready_cnt--;
+}
+
+/* Returns the highest priority with a ready thread, or -1 if no
+   thread is ready.  Interrupts must be off. */
+static int
+ready_max_priority (void)
+{
+  int word;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (word = sizeof ready_mask / sizeof *ready_mask - 1; word >= 0; word--)
+    if (ready_mask[word] != 0)
+      return word * 32 + 31 - __builtin_clz (ready_mask[word]);
+  return -1;
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -585,6 +917,13 @@ schedule (void)
   ASSERT (cur->status != THREAD_RUNNING);
   ASSERT (is_thread (next));
 
+  /* Restart the periodic timer interrupt, if tickless idle
+     stopped it, before any other thread runs.  This is the only
+     way the idle thread gives up the CPU, whether it blocks or
+     is preempted on return from the interrupt that woke it. */
+  if (cur == idle_thread && next != idle_thread)
+    timer_idle_exit ();
+
   if (cur != next)
     prev = switch_threads (cur, next);
   thread_schedule_tail (prev);
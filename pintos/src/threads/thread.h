@@ -2,10 +2,14 @@
 #define THREADS_THREAD_H
 
 #include <debug.h>
+#include <hash.h>
 #include <list.h>
 #include <stdint.h>
 #include "threads/synch.h"
 #include "threads/fixed-point.h"
+#ifdef USERPROG
+#include "userprog/fdtable.h"
+#endif
 
 /* States in a thread's life cycle. */
 enum thread_status
@@ -27,6 +31,22 @@ typedef int pid_t;
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+/* Priority classes, each with its own time slice.  Low class is
+   priorities PRI_MIN through 15, high class 48 through PRI_MAX,
+   and normal class the rest. */
+enum pri_class
+  {
+    PRI_CLASS_LOW,
+    PRI_CLASS_NORMAL,
+    PRI_CLASS_HIGH,
+    PRI_CLASS_CNT
+  };
+
+/* Thread niceness, for the multi-level feedback queue scheduler. */
+#define NICE_MIN -20                    /* Nicest. */
+#define NICE_DEFAULT 0                  /* Default niceness. */
+#define NICE_MAX 20                     /* Least nice. */
+
 /* A kernel thread or user process.
 
    Each thread structure is stored in its own 4 kB page.  The
@@ -90,11 +110,23 @@ struct thread
     enum thread_status status;          /* Thread state. */
     char name[16];                      /* Name (for debugging purposes). */
     uint8_t *stack;                     /* Saved stack pointer. */
-    int priority;                       /* Priority. */
+    int priority;                       /* Priority, including donations. */
+    int base_priority;                  /* Priority without donations. */
     struct list_elem allelem;           /* List element for all threads list. */
 
-    /* Shared between thread.c and synch.c. */
+    int nice;                           /* Niceness, under -mlfqs. */
+    fixed_point_t recent_cpu;           /* Recent CPU use, under -mlfqs. */
+
+    /* Owned by synch.c. */
+    struct list locks;                  /* Locks held, for donation. */
+    struct lock *waiting_on;            /* Lock being waited for, if any. */
+
+    /* Shared between thread.c, synch.c and devices/timer.c. */
     struct list_elem elem;              /* List element. */
+
+    /* Owned by devices/timer.c. */
+    int64_t wake_tick;                  /* Tick to wake at, if sleeping. */
+
     struct list_elem parent_elem;       /* allelem for thread's parent */
     bool has_parent;
     int parID;
@@ -110,8 +142,20 @@ struct thread
     /* Owned by userprog/process.c. */
     uint32_t *pagedir;                  /* Page directory. */
 #endif
-    
-    struct wrapper *files[130];
+#ifdef VM
+    /* Owned by vm/page.c. */
+    struct hash pages;                  /* Supplemental page table. */
+    void *user_esp;                     /* User esp on entry to kernel. */
+
+    /* Owned by vm/mmap.c. */
+    struct list mappings;               /* Memory-mapped files. */
+    int next_mapid;                     /* Next mapping identifier. */
+#endif
+
+#ifdef USERPROG
+    /* Owned by userprog/fdtable.c. */
+    struct fd_table fds;                /* Open files. */
+#endif
     struct dir *cwd;
 
     /* Owned by thread.c. */
@@ -131,10 +175,16 @@ struct child_process_info
    Controlled by kernel command-line option "-o mlfqs". */
 extern bool thread_mlfqs;
 
+/* Timer ticks a thread may run before yielding to a thread of
+   the same priority, by priority class.  Set by the kernel's
+   -slice option. */
+extern unsigned thread_time_slice[PRI_CLASS_CNT];
+
 void thread_init (void);
 void thread_start (void);
 
 void thread_tick (void);
+void thread_idle_ticks (int64_t cnt);
 void thread_print_stats (void);
 
 typedef void thread_func (void *aux);
@@ -142,6 +192,7 @@ tid_t thread_create (const char *name, int priority, thread_func *, void *);
 
 void thread_block (void);
 void thread_unblock (struct thread *);
+void thread_preempt (void);
 
 struct thread *thread_current (void);
 tid_t thread_tid (void);
@@ -156,6 +207,8 @@ void thread_foreach (thread_action_func *, void *);
 
 int thread_get_priority (void);
 void thread_set_priority (int);
+void thread_set_effective_priority (struct thread *, int);
+void thread_refresh_priority (struct thread *);
 
 int thread_get_nice (void);
 void thread_set_nice (int);
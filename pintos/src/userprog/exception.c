@@ -6,6 +6,10 @@
 #include "threads/thread.h"
 #include "userprog/syscall.h"
 #include "userprog/process.h"
+#ifdef VM
+#include "threads/vaddr.h"
+#include "vm/page.h"
+#endif
 
 /* Number of page faults processed. */
 static long long page_fault_cnt;
@@ -157,9 +161,24 @@ page_fault (struct intr_frame *f)
   write = (f->error_code & PF_W) != 0;
   user = (f->error_code & PF_U) != 0;
 
-  /* To implement virtual memory, delete the rest of the function
-     body, and replace it with code that brings in the page to
-     which fault_addr refers. */
+#ifdef VM
+  /* Bring in a page that the process has not touched yet, or
+     grow its stack.  This also covers the kernel touching such a
+     page on the process's behalf, e.g. while copying a system
+     call argument, in which case the interrupt frame holds no
+     user stack pointer and the one saved on entry to the system
+     call is used. */
+  if (not_present && is_user_vaddr (fault_addr)
+      && page_fault_in (fault_addr, (user ? f->esp
+                                     : thread_current ()->user_esp)))
+    return;
+
+  /* Copy a page shared with a fork()ed process on first write. */
+  if (!not_present && write && is_user_vaddr (fault_addr)
+      && page_unshare (fault_addr))
+    return;
+#endif
+
   printf ("Page fault at %p: %s error %s page in %s context.\n",
           fault_addr,
           not_present ? "not present" : "rights violation",
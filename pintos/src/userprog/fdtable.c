@@ -0,0 +1,137 @@
+#include "userprog/fdtable.h"
+#include <debug.h>
+#include <string.h>
+#include "threads/malloc.h"
+
+/* Size of a table when it first grows. */
+#define FD_INITIAL_SIZE 16
+
+static bool grow (struct fd_table *);
+
+/* Initializes T as an empty table.  Nothing is allocated until
+   the first file is opened. */
+void
+fd_table_init (struct fd_table *t)
+{
+  t->files = NULL;
+  t->next_free = NULL;
+  t->size = 0;
+  t->free = -1;
+}
+
+/* Initializes DST, which must be empty, as a copy of SRC, for
+   fork().  Each open file is copied with COPY and gets the same
+   descriptor in DST.  Returns false if memory allocation fails
+   or COPY returns a null pointer, in which case DST holds the
+   files copied so far and must still be destroyed. */
+bool
+fd_table_copy (struct fd_table *dst, const struct fd_table *src,
+               fd_copy_func *copy)
+{
+  int fd;
+
+  ASSERT (dst->size == 0);
+
+  if (src->size == 0)
+    return true;
+  dst->files = calloc (src->size, sizeof *dst->files);
+  dst->next_free = malloc (src->size * sizeof *dst->next_free);
+  if (dst->files == NULL || dst->next_free == NULL)
+    return false;
+  memcpy (dst->next_free, src->next_free, src->size * sizeof *dst->next_free);
+  dst->size = src->size;
+  dst->free = src->free;
+
+  for (fd = FD_MIN; fd < src->size; fd++)
+    if (src->files[fd] != NULL)
+      {
+        dst->files[fd] = copy (src->files[fd]);
+        if (dst->files[fd] == NULL)
+          return false;
+      }
+  return true;
+}
+
+/* Frees T's storage.  The files in it must already be closed. */
+void
+fd_table_destroy (struct fd_table *t)
+{
+  free (t->files);
+  free (t->next_free);
+  fd_table_init (t);
+}
+
+/* Adds W to T under the most recently freed descriptor, or the
+   lowest never used if none has been freed, and returns the
+   descriptor, or -1 if memory allocation fails. */
+int
+fd_alloc (struct fd_table *t, struct wrapper *w)
+{
+  int fd;
+
+  ASSERT (w != NULL);
+
+  if (t->free == -1 && !grow (t))
+    return -1;
+  fd = t->free;
+  t->free = t->next_free[fd];
+  t->files[fd] = w;
+  return fd;
+}
+
+/* Returns the file open as FD in T, or a null pointer if FD is
+   not an open file descriptor. */
+struct wrapper *
+fd_get (const struct fd_table *t, int fd)
+{
+  return fd >= FD_MIN && fd < t->size ? t->files[fd] : NULL;
+}
+
+/* Removes the file open as FD from T and returns it, or returns a
+   null pointer if FD is not an open file descriptor. */
+struct wrapper *
+fd_free (struct fd_table *t, int fd)
+{
+  struct wrapper *w = fd_get (t, fd);
+
+  if (w != NULL)
+    {
+      t->files[fd] = NULL;
+      t->next_free[fd] = t->free;
+      t->free = fd;
+    }
+  return w;
+}
+
+/* Doubles the size of T, which must have no free descriptors,
+   and puts the new descriptors on its free list, lowest first.
+   Returns false if memory allocation fails. */
+static bool
+grow (struct fd_table *t)
+{
+  int new_size = t->size > 0 ? t->size * 2 : FD_INITIAL_SIZE;
+  struct wrapper **files;
+  int *next_free;
+  int fd;
+
+  files = realloc (t->files, new_size * sizeof *files);
+  if (files == NULL)
+    return false;
+  t->files = files;
+  next_free = realloc (t->next_free, new_size * sizeof *next_free);
+  if (next_free == NULL)
+    return false;
+  t->next_free = next_free;
+
+  for (fd = new_size - 1; fd >= t->size; fd--)
+    {
+      t->files[fd] = NULL;
+      if (fd >= FD_MIN)
+        {
+          t->next_free[fd] = t->free;
+          t->free = fd;
+        }
+    }
+  t->size = new_size;
+  return true;
+}
@@ -0,0 +1,37 @@
+#ifndef USERPROG_FDTABLE_H
+#define USERPROG_FDTABLE_H
+
+#include <stdbool.h>
+
+struct wrapper;
+
+/* First file descriptor handed out.  0 and 1 are the console. */
+#define FD_MIN 2
+
+/* A process's open files, indexed by file descriptor.
+
+   The table starts empty and doubles in size whenever it runs
+   out of free descriptors.  Free descriptors are kept on a list
+   threaded through NEXT_FREE, so that opening and closing a file
+   take constant time apart from the occasional growth. */
+struct fd_table
+  {
+    struct wrapper **files;     /* Open files, null where free. */
+    int *next_free;             /* For each free fd, the next one. */
+    int size;                   /* Number of descriptors in table. */
+    int free;                   /* First free descriptor, or -1. */
+  };
+
+/* Copies an open file for fd_table_copy(). */
+typedef struct wrapper *fd_copy_func (struct wrapper *);
+
+void fd_table_init (struct fd_table *);
+bool fd_table_copy (struct fd_table *, const struct fd_table *,
+                    fd_copy_func *);
+void fd_table_destroy (struct fd_table *);
+
+int fd_alloc (struct fd_table *, struct wrapper *);
+struct wrapper *fd_get (const struct fd_table *, int fd);
+struct wrapper *fd_free (struct fd_table *, int fd);
+
+#endif /* userprog/fdtable.h */
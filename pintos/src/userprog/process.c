@@ -14,14 +14,34 @@
 #include "threads/flags.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "userprog/syscall.h"
+#ifdef VM
+#include "vm/mmap.h"
+#include "vm/page.h"
+#include "vm/pagecache.h"
+#endif
 
 static thread_func start_process NO_RETURN;
 static bool load (char *cmdline, void (**eip) (void), void **esp);
+static void add_child (struct thread *child, tid_t tid);
+#ifdef VM
+static thread_func start_fork NO_RETURN;
+static bool copy_process (struct thread *parent);
+static fd_copy_func copy_file;
+
+/* Arguments passed from process_fork() to start_fork(). */
+struct fork_args
+  {
+    struct thread *parent;              /* Process being forked. */
+    const struct intr_frame *if_;       /* Parent's user registers. */
+    bool success;                       /* Copied successfully? */
+  };
+#endif
 
 /* Starts a new thread running a user program loaded from
    FILENAME.  The new thread may be scheduled (and may even exit)
@@ -70,30 +90,177 @@ process_execute (const char *file_name)
   sema_down (&child->load_sema);
   if (args.loaded)
     { 
-      struct thread *t = list_entry (&thread_current ()->allelem, struct thread, allelem);
+      add_child (child, tid);
+      lock_release (&execute_lock);
+      return tid;
+    }
 
-      child->parID = thread_current ()->tid;
-      child->has_parent = true;
+  lock_release (&execute_lock);
+  return -1;
+}
 
-      struct child_process_info *cpi = palloc_get_page (0);
-      child->cpi = cpi;
-      cpi->pid = tid;
-      cpi->waited = false;
-      cpi->exit_status = 300;
+/* Records CHILD, whose thread id is TID, as a child of the
+   current process, so that the current process can wait for it.
+   execute_lock must be held, which keeps CHILD from running user
+   code in the meantime. */
+static void
+add_child (struct thread *child, tid_t tid)
+{
+  child->parID = thread_current ()->tid;
+  child->has_parent = true;
 
-      lock_acquire (&exit_lock);
-      list_push_back (&thread_current ()->child_process_structs, &cpi->info_elem);
-      thread_current ()->num_cpi++;
-      lock_release (&exit_lock);
+  struct child_process_info *cpi = palloc_get_page (0);
+  child->cpi = cpi;
+  cpi->pid = tid;
+  cpi->waited = false;
+  cpi->exit_status = 300;
 
+  lock_acquire (&exit_lock);
+  list_push_back (&thread_current ()->child_process_structs, &cpi->info_elem);
+  thread_current ()->num_cpi++;
+  lock_release (&exit_lock);
+}
+
+#ifdef VM
+/* Starts a new process that is a copy of the current one, which
+   entered the kernel with user registers IF_.  The copy shares
+   the current process's memory copy-on-write and has its own
+   copies of its open files, which start at the same positions,
+   and of its working directory.  It starts running at the same
+   point, but sees fork() return 0.  Returns the new process's
+   thread id, or TID_ERROR if the copy cannot be made. */
+tid_t
+process_fork (const struct intr_frame *if_)
+{
+  struct fork_args args;
+  struct thread *child;
+  tid_t tid;
+
+  args.parent = thread_current ();
+  args.if_ = if_;
+  args.success = false;
+
+  lock_acquire (&execute_lock);
+  tid = thread_create (thread_name (), PRI_DEFAULT, start_fork, &args);
+  if (tid == TID_ERROR)
+    {
       lock_release (&execute_lock);
-      return tid;
+      return TID_ERROR;
     }
 
+  /* The child cannot exit before it takes execute_lock, so it
+     is still there to be found. */
+  child = thread_find (tid);
+  sema_down (&child->load_sema);
+  if (args.success)
+    add_child (child, tid);
+  else
+    tid = TID_ERROR;
   lock_release (&execute_lock);
-  return -1;
+  return tid;
 }
 
+/* A thread function that copies the process that ARGS, a struct
+   fork_args, refers to into the new thread and starts it
+   running. */
+static void
+start_fork (void *args_)
+{
+  struct fork_args *args = args_;
+  struct intr_frame if_ = *args->if_;
+  bool success;
+
+  success = copy_process (args->parent);
+  args->success = success;
+  sema_up (&thread_current ()->load_sema);
+
+  /* Wait for the parent to record this process as its child,
+     or to give up on it. */
+  lock_acquire (&execute_lock);
+  lock_release (&execute_lock);
+  if (!success)
+    thread_exit ();
+
+  /* Return to user mode where the parent's fork() call left
+     off, as in start_process(). */
+  if_.eax = 0;
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+
+/* Copies PARENT's address space, executable and open files into
+   the current thread.  The working directory was already copied
+   when the thread was created.  Returns true if successful,
+   false if memory allocation fails, leaving whatever was copied
+   for process_exit() to free. */
+static bool
+copy_process (struct thread *parent)
+{
+  struct thread *t = thread_current ();
+  bool success = true;
+
+  /* Allocate and activate page directory, as in load(). */
+  t->pagedir = pagedir_create ();
+  if (t->pagedir == NULL)
+    return false;
+  if (!page_table_init (&t->pages))
+    {
+      pagedir_destroy (t->pagedir);
+      t->pagedir = NULL;
+      return false;
+    }
+  process_activate ();
+
+  /* Each process needs its own struct file for each open file,
+     so the copies have their own positions after this. */
+  lock_acquire (&close_lock);
+  t->executable = file_reopen (parent->executable);
+  if (t->executable != NULL)
+    file_deny_write (t->executable);
+  else
+    success = false;
+  if (success)
+    success = fd_table_copy (&t->fds, &parent->fds, copy_file);
+  lock_release (&close_lock);
+
+  return (success && page_table_copy (parent, t->executable)
+          && mmap_copy (parent));
+}
+
+/* Returns a new struct wrapper that refers to the same file or
+   directory as PW, at the same position, or a null pointer if
+   memory allocation fails. */
+static struct wrapper *
+copy_file (struct wrapper *pw)
+{
+  struct wrapper *w = malloc (sizeof *w);
+
+  if (w == NULL)
+    return NULL;
+  w->is_dir = pw->is_dir;
+  w->file = NULL;
+  w->dir = NULL;
+  if (pw->is_dir)
+    {
+      w->dir = dir_reopen (pw->dir);
+      if (w->dir != NULL)
+        w->dir->pos = pw->dir->pos;
+    }
+  else
+    {
+      w->file = file_reopen (pw->file);
+      if (w->file != NULL)
+        file_seek (w->file, file_tell (pw->file));
+    }
+  if (w->file == NULL && w->dir == NULL)
+    {
+      free (w);
+      return NULL;
+    }
+  return w;
+}
+#endif
+
 /* A thread function that loads a user process and starts it
    running. */
 static void
@@ -213,25 +380,36 @@ process_exit (void)
   lock_release (&exit_lock);
 
   lock_acquire (&close_lock);
-  int i;
-  for (i = 2; i < 130; i++) 
+  int fd;
+  for (fd = FD_MIN; fd < cur->fds.size; fd++) 
     {
-      if (cur->files[i] != NULL) 
+      struct wrapper *w = fd_free (&cur->fds, fd);
+      if (w != NULL) 
         {
-          if (!cur->files[i]->is_dir && cur->files[i]->file != cur->executable)
-            file_close (cur->files[i]->file);
-          else if (cur->files[i]->is_dir)
-            dir_close (cur->files[i]->dir);
-          palloc_free_page (cur->files[i]);
-          cur->files[i] = NULL;
+          if (!w->is_dir && w->file != cur->executable)
+            file_close (w->file);
+          else if (w->is_dir)
+            dir_close (w->dir);
+          free (w);
         }
     }
+  fd_table_destroy (&cur->fds);
   if (cur->executable != NULL) 
     file_close (cur->executable);
   
   cur->executable = NULL;
   lock_release (&close_lock);
 
+#ifdef VM
+  /* Write back mapped files, then free the process's frames and
+     swap slots while its page directory still maps them. */
+  if (cur->pagedir != NULL)
+    {
+      mmap_unmap_all ();
+      page_table_destroy (&cur->pages);
+    }
+#endif
+
   /* Destroy the current process's page directory and switch back
      to the kernel-only page directory. */
   pd = cur->pagedir;
@@ -364,6 +542,16 @@ load (char *file_name, void (**eip) (void), void **esp)
   t->pagedir = pagedir_create ();
   if (t->pagedir == NULL)
     goto done;
+#ifdef VM
+  if (!page_table_init (&t->pages))
+    {
+      /* process_exit() destroys the page table along with the
+         page directory, so neither may be left half set up. */
+      pagedir_destroy (t->pagedir);
+      t->pagedir = NULL;
+      goto done;
+    }
+#endif
   process_activate ();
 
   /* Open executable file. */
@@ -490,7 +678,9 @@ load (char *file_name, void (**eip) (void), void **esp)
 
 /* load() helpers. */
 
+#ifndef VM
 static bool install_page (void *upage, void *kpage, bool writable);
+#endif
 
 /* Checks whether PHDR describes a valid, loadable segment in
    FILE and returns true if so, false otherwise. */
@@ -549,6 +739,10 @@ validate_segment (const struct Elf32_Phdr *phdr, struct file *file)
    The pages initialized by this function must be writable by the
    user process if WRITABLE is true, read-only otherwise.
 
+   With VM, the pages are only recorded in the supplemental page
+   table here, and each is read or zeroed when the process first
+   touches it.
+
    Return true if successful, false if a memory allocation error
    or disk read error occurs. */
 static bool
@@ -568,6 +762,26 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
       size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
       size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
+#ifdef VM
+      /* Record the page, to be loaded on first touch.  Read-only
+         pages are shared with other processes running the same
+         executable. */
+      if (!writable && page_read_bytes > 0)
+        {
+          struct file_page *fp = pagecache_get (file_get_inode (file), ofs,
+                                                page_read_bytes, true);
+          if (fp == NULL)
+            return false;
+          if (!page_add_text (upage, fp))
+            {
+              pagecache_put (fp);
+              return false;
+            }
+        }
+      else if (!page_add_file (upage, file, ofs, page_read_bytes, writable))
+        return false;
+      ofs += page_read_bytes;
+#else
       /* Get a page of memory. */
       uint8_t *kpage = palloc_get_page (PAL_USER);
       if (kpage == NULL)
@@ -587,6 +801,7 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
           palloc_free_page (kpage);
           return false;
         }
+#endif
 
       /* Advance. */
       read_bytes -= page_read_bytes;
@@ -596,75 +811,88 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   return true;
 }
 
-/* Create a minimal stack by mapping a zeroed page at the top of
-   user virtual memory. */
+/* Creates a stack at the top of user virtual memory and pushes
+   the words of ARGS, which are separated by spaces, onto it as
+   the arguments to main().  Without VM the stack is a single
+   page.  With VM it starts with as many pages as the arguments
+   need, up to the stack limit, and grows on demand after that.
+   Stores the initial stack pointer into *ESP. */
 static bool
 setup_stack (void **esp, char *args)
 {
+  size_t len = strlen (args);
+  size_t argc = 0, str_bytes = 0, size, i;
+  char *save_ptr, *token, *p;
+  char *str, **argv;
+  void **sp;
+#ifndef VM
   uint8_t *kpage;
-  bool success = false;
+#endif
 
-  kpage = palloc_get_page (PAL_USER | PAL_ZERO);
-  if (kpage != NULL)
+  /* Split ARGS into null-terminated words in place, counting
+     them and the bytes they take. */
+  for (token = strtok_r (args, " ", &save_ptr); token != NULL;
+       token = strtok_r (NULL, " ", &save_ptr))
     {
-      success = install_page (((uint8_t *) PHYS_BASE) - PGSIZE, kpage, true);
-      if (success) 
-        {
-          *esp = PHYS_BASE;
-
-          size_t total = 0;
-          size_t MAX_ARGS = 20;
-          size_t num_args = 0;
-          void *arg_ptrs[MAX_ARGS];
-          char *save_ptr;
-
-          char delim[2] = {' ', '\0'};
-          args = strtok_r (args, delim, &save_ptr);
-
-          // Split up args and put into stack.
+      argc++;
+      str_bytes += strlen (token) + 1;
+    }
 
-          do 
-            {
-              *esp -= strlen (args) + 1;
-              strlcpy (*esp, args, strlen (args) + 1);
-              arg_ptrs[num_args] = *esp;
-              total += strlen (args) + 1;
-              num_args += 1;
-              args = strtok_r (NULL, delim, &save_ptr);
-            } while (args != NULL);
-
-          // Word align
-          if (total % 4 != 0)
-            *esp -= 4 - (total % 4);
-
-          // Null terminate list of args.
-          *esp -= 4;
-          strlcpy (*esp, "\0\0\0", 4);
-
-          // Push pointers to args.
-          int i;
-          for (i = num_args - 1; i >= 0; i--) 
-            {
-              *esp -= 4;
-              *(char **)(*esp) = arg_ptrs[i];
-            }
+  /* The words, padding to a word boundary, argv[0] through
+     argv[argc], then argv, argc and a return address. */
+  size = (ROUND_UP (str_bytes, sizeof (char *))
+          + (argc + 1) * sizeof (char *) + 3 * sizeof (void *));
 
-          // Push argv and argc and fake return address.
-          *esp -= 4;
-          *(char ***)(*esp) = *esp + 4;
-          *esp -= 4;
-          *(int *)(*esp) = num_args;
-          *esp -= 4;
-          *(void (**) ())(*esp) = 0;
-
-        } 
-      else
-        palloc_free_page (kpage);
+#ifdef VM
+  /* The stack pages are ordinary zero pages that may be evicted
+     like any other, so the arguments below are written to them
+     through their user addresses. */
+  if (ROUND_UP (size, PGSIZE) > page_stack_limit)
+    return false;
+  for (i = 1; i <= DIV_ROUND_UP (size, PGSIZE); i++)
+    if (!page_add_zero ((uint8_t *) PHYS_BASE - i * PGSIZE, true))
+      return false;
+#else
+  if (size > PGSIZE)
+    return false;
+  kpage = palloc_get_page (PAL_USER | PAL_ZERO);
+  if (kpage == NULL)
+    return false;
+  if (!install_page (((uint8_t *) PHYS_BASE) - PGSIZE, kpage, true))
+    {
+      palloc_free_page (kpage);
+      return false;
     }
+#endif
+
+  /* Copy the words to the top of the stack in order, filling in
+     argv as we go.  strtok_r() left each word null-terminated,
+     with only spaces and null bytes in between. */
+  str = (char *) PHYS_BASE - str_bytes;
+  argv = (char **) ROUND_DOWN ((uintptr_t) str, sizeof (char *)) - (argc + 1);
+  i = 0;
+  for (p = args; p < args + len; p++)
+    if (*p != ' ' && *p != '\0')
+      {
+        size_t word_len = strlen (p);
+        memcpy (str, p, word_len + 1);
+        argv[i++] = str;
+        str += word_len + 1;
+        p += word_len;
+      }
+  argv[argc] = NULL;
+
+  /* Push argv, argc and a fake return address. */
+  sp = (void **) argv;
+  *--sp = argv;
+  *--sp = (void *) argc;
+  *--sp = NULL;
+  *esp = sp;
 
-  return success;
+  return true;
 }
 
+#ifndef VM
 /* Adds a mapping from user virtual address UPAGE to kernel
    virtual address KPAGE to the page table.
    If WRITABLE is true, the user process may modify the page;
@@ -684,3 +912,4 @@ install_page (void *upage, void *kpage, bool writable)
   return (pagedir_get_page (t->pagedir, upage) == NULL
           && pagedir_set_page (t->pagedir, upage, kpage, writable));
 }
+#endif
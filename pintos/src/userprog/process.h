@@ -16,6 +16,10 @@ struct arg_struct
   };
 
 tid_t process_execute (const char *file_name);
+#ifdef VM
+struct intr_frame;
+tid_t process_fork (const struct intr_frame *);
+#endif
 int process_wait (tid_t);
 void process_exit (void);
 void process_activate (void);
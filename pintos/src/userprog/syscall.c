@@ -5,14 +5,39 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <syscall-nr.h>
+#include "threads/cpu.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/thread.h"
 #include <string.h>
 #include "userprog/pagedir.h"
+#include "filesys/cache.h"
 #include "filesys/inode.h"
 #include "filesys/filesys.h"
 #include "filesys/file.h"
 #include "filesys/directory.h"
+#ifdef VM
+#include "vm/mmap.h"
+#include "vm/page.h"
+#endif
+
+/* Most arguments that any system call takes. */
+#define SYSCALL_MAX_ARGS 3
+
+/* A system call handler.  ARGV holds the call's arguments and F
+   the user's registers, in which the handler stores any return
+   value. */
+typedef void syscall_func (const uint32_t argv[], struct intr_frame *f);
+
+/* An entry in the system call dispatch table. */
+struct syscall
+  {
+    const char *name;           /* Name, for statistics. */
+    syscall_func *func;         /* Handler. */
+    int arg_cnt;                /* Number of arguments. */
+    long long call_cnt;         /* Number of calls. */
+    uint64_t cycles;            /* CPU cycles spent in calls that returned. */
+  };
 
 static void syscall_handler (struct intr_frame *);
 
@@ -21,6 +46,13 @@ bool remove_handler (const char *file);
 
 static void check_pointer (const void *vaddr, int buffer_size);
 static void check_buffer (const void *vaddr, int buffer_size);
+static void pin_buffer (const void *buffer, unsigned size, bool write);
+static void unpin_buffer (const void *buffer, unsigned size);
+static int transfer_vector (int fd, const struct iovec *, int iovcnt,
+                            bool write);
+
+/* Most buffers that readv() and writev() accept. */
+#define IOV_MAX 1024
 
 void
 syscall_init (void)
@@ -31,87 +63,294 @@ syscall_init (void)
   lock_init (&execute_lock);
   lock_init (&load_lock);
   lock_init (&close_lock);
-  cache_init ();
 }
 
+/* Adapters from the dispatch table to the handlers.  Each takes
+   the system call's arguments, already copied from the user
+   stack, and stores any return value in F's eax member. */
+
 static void
-syscall_handler (struct intr_frame *f UNUSED)
+sys_halt (const uint32_t argv[] UNUSED, struct intr_frame *f UNUSED)
 {
-  uint32_t* args = ((uint32_t*) f->esp);
-  check_pointer (args, -1);
+  halt_handler ();
+}
 
-  if (args[0] == SYS_EXIT) 
-    {
-      if (!is_user_vaddr (args[1]))
-        exit_handler (-1);
-      f->eax = args[1];
-      exit_handler (args[1]);
-    }
-  if (args[0] == SYS_PRACTICE)
-    f->eax = practice_handler (args[1]);
-  if (args[0] == SYS_WRITE) 
-    {
-      check_pointer (args[2], args[3]);
-    	f->eax = write_handler (args[1], args[2], args[3]);
-    }
-  if (args[0] == SYS_CREATE) 
-    {
-      check_pointer (args[1], args[2]);
-      f->eax = create_handler (args[1], args[2]);
-    }
-  if (args[0] == SYS_REMOVE)
-    {
-      if (!is_user_vaddr (args[1]))
-        exit_handler (-1);
-      f->eax = remove_handler (args[1]);
-    }
-  if (args[0] == SYS_OPEN) 
+static void
+sys_exit (const uint32_t argv[], struct intr_frame *f UNUSED)
+{
+  exit_handler (argv[0]);
+}
+
+static void
+sys_exec (const uint32_t argv[], struct intr_frame *f)
+{
+  f->eax = exec_handler ((const char *) argv[0]);
+}
+
+static void
+sys_wait (const uint32_t argv[], struct intr_frame *f)
+{
+  f->eax = wait_handler (argv[0]);
+}
+
+static void
+sys_create (const uint32_t argv[], struct intr_frame *f)
+{
+  check_pointer ((const void *) argv[0], argv[1]);
+  f->eax = create_handler ((const char *) argv[0], argv[1]);
+}
+
+static void
+sys_remove (const uint32_t argv[], struct intr_frame *f)
+{
+  if (!is_user_vaddr ((const void *) argv[0]))
+    exit_handler (-1);
+  f->eax = remove_handler ((const char *) argv[0]);
+}
+
+static void
+sys_open (const uint32_t argv[], struct intr_frame *f)
+{
+  if (!is_user_vaddr ((const void *) argv[0]))
+    exit_handler (-1);
+  f->eax = open_handler ((const char *) argv[0]);
+}
+
+static void
+sys_filesize (const uint32_t argv[], struct intr_frame *f)
+{
+  f->eax = filesize_handler (argv[0]);
+}
+
+static void
+sys_read (const uint32_t argv[], struct intr_frame *f)
+{
+  f->eax = read_handler (argv[0], (void *) argv[1], argv[2]);
+}
+
+static void
+sys_write (const uint32_t argv[], struct intr_frame *f)
+{
+  f->eax = write_handler (argv[0], (const void *) argv[1], argv[2]);
+}
+
+static void
+sys_seek (const uint32_t argv[], struct intr_frame *f UNUSED)
+{
+  seek_handler (argv[0], argv[1]);
+}
+
+static void
+sys_tell (const uint32_t argv[], struct intr_frame *f)
+{
+  f->eax = tell_handler (argv[0]);
+}
+
+static void
+sys_close (const uint32_t argv[], struct intr_frame *f UNUSED)
+{
+  close_handler (argv[0]);
+}
+
+static void
+sys_readv (const uint32_t argv[], struct intr_frame *f)
+{
+  f->eax = readv_handler (argv[0], (const struct iovec *) argv[1], argv[2]);
+}
+
+static void
+sys_writev (const uint32_t argv[], struct intr_frame *f)
+{
+  f->eax = writev_handler (argv[0], (const struct iovec *) argv[1], argv[2]);
+}
+
+static void
+sys_io_enter (const uint32_t argv[], struct intr_frame *f)
+{
+  f->eax = io_enter_handler ((struct io_ring *) argv[0]);
+}
+
+static void
+sys_practice (const uint32_t argv[], struct intr_frame *f)
+{
+  f->eax = practice_handler (argv[0]);
+}
+
+#ifdef VM
+static void
+sys_mmap (const uint32_t argv[], struct intr_frame *f)
+{
+  f->eax = mmap_handler (argv[0], (void *) argv[1]);
+}
+
+static void
+sys_munmap (const uint32_t argv[], struct intr_frame *f UNUSED)
+{
+  munmap_handler (argv[0]);
+}
+
+static void
+sys_fork (const uint32_t argv[] UNUSED, struct intr_frame *f)
+{
+  f->eax = fork_handler (f);
+}
+#endif
+
+static void
+sys_chdir (const uint32_t argv[], struct intr_frame *f)
+{
+  f->eax = chdir_handler ((const char *) argv[0]);
+}
+
+static void
+sys_mkdir (const uint32_t argv[], struct intr_frame *f)
+{
+  f->eax = mkdir_handler ((const char *) argv[0]);
+}
+
+static void
+sys_readdir (const uint32_t argv[], struct intr_frame *f)
+{
+  f->eax = readdir_handler (argv[0], (char *) argv[1]);
+}
+
+static void
+sys_isdir (const uint32_t argv[], struct intr_frame *f)
+{
+  f->eax = isdir_handler (argv[0]);
+}
+
+static void
+sys_inumber (const uint32_t argv[], struct intr_frame *f)
+{
+  f->eax = inumber_handler (argv[0]);
+}
+
+static void
+sys_cacheh (const uint32_t argv[] UNUSED, struct intr_frame *f)
+{
+  f->eax = cacheh_handler ();
+}
+
+static void
+sys_cachem (const uint32_t argv[] UNUSED, struct intr_frame *f)
+{
+  f->eax = cachem_handler ();
+}
+
+static void
+sys_cachep (const uint32_t argv[] UNUSED, struct intr_frame *f)
+{
+  f->eax = cachep_handler ();
+}
+
+static void
+sys_blockr (const uint32_t argv[] UNUSED, struct intr_frame *f)
+{
+  f->eax = blockr_handler ();
+}
+
+static void
+sys_blockw (const uint32_t argv[] UNUSED, struct intr_frame *f)
+{
+  f->eax = blockw_handler ();
+}
+
+static void
+sys_cacheclear (const uint32_t argv[] UNUSED, struct intr_frame *f UNUSED)
+{
+  cacheclear_handler ();
+}
+
+/* System call dispatch table, indexed by system call number.
+   Numbers without a handler in this kernel have a null FUNC. */
+static struct syscall syscalls[] =
+  {
+    [SYS_HALT] = {"halt", sys_halt, 0},
+    [SYS_EXIT] = {"exit", sys_exit, 1},
+    [SYS_EXEC] = {"exec", sys_exec, 1},
+    [SYS_WAIT] = {"wait", sys_wait, 1},
+    [SYS_CREATE] = {"create", sys_create, 2},
+    [SYS_REMOVE] = {"remove", sys_remove, 1},
+    [SYS_OPEN] = {"open", sys_open, 1},
+    [SYS_FILESIZE] = {"filesize", sys_filesize, 1},
+    [SYS_READ] = {"read", sys_read, 3},
+    [SYS_WRITE] = {"write", sys_write, 3},
+    [SYS_SEEK] = {"seek", sys_seek, 2},
+    [SYS_TELL] = {"tell", sys_tell, 1},
+    [SYS_CLOSE] = {"close", sys_close, 1},
+    [SYS_READV] = {"readv", sys_readv, 3},
+    [SYS_WRITEV] = {"writev", sys_writev, 3},
+    [SYS_IO_ENTER] = {"io_enter", sys_io_enter, 1},
+    [SYS_PRACTICE] = {"practice", sys_practice, 1},
+#ifdef VM
+    [SYS_MMAP] = {"mmap", sys_mmap, 2},
+    [SYS_MUNMAP] = {"munmap", sys_munmap, 1},
+    [SYS_FORK] = {"fork", sys_fork, 0},
+#endif
+    [SYS_CHDIR] = {"chdir", sys_chdir, 1},
+    [SYS_MKDIR] = {"mkdir", sys_mkdir, 1},
+    [SYS_READDIR] = {"readdir", sys_readdir, 2},
+    [SYS_ISDIR] = {"isdir", sys_isdir, 1},
+    [SYS_INUMBER] = {"inumber", sys_inumber, 1},
+    [SYS_CACHEH] = {"cacheh", sys_cacheh, 0},
+    [SYS_CACHEM] = {"cachem", sys_cachem, 0},
+    [SYS_BLOCKR] = {"blockr", sys_blockr, 0},
+    [SYS_BLOCKW] = {"blockw", sys_blockw, 0},
+    [SYS_CACHECLEAR] = {"cacheclear", sys_cacheclear, 0},
+    [SYS_CACHEP] = {"cachep", sys_cachep, 0},
+  };
+
+#define SYSCALL_CNT (sizeof syscalls / sizeof *syscalls)
+
+/* Looks up the system call whose number is on top of the user
+   stack, copies its arguments from the stack once the stack is
+   known to hold them all, and calls its handler.  A process that
+   passes a bad stack pointer or an unknown system call number is
+   terminated. */
+static void
+syscall_handler (struct intr_frame *f)
+{
+  const uint32_t *args = f->esp;
+  uint32_t argv[SYSCALL_MAX_ARGS];
+  struct syscall *sc;
+  uint64_t start;
+  int i;
+
+#ifdef VM
+  thread_current ()->user_esp = f->esp;
+#endif
+  check_pointer (args, sizeof *args);
+  if (args[0] >= SYSCALL_CNT || syscalls[args[0]].func == NULL)
+    exit_handler (-1);
+  sc = &syscalls[args[0]];
+
+  check_pointer (args, (sc->arg_cnt + 1) * sizeof *args);
+  for (i = 0; i < sc->arg_cnt; i++)
+    argv[i] = args[i + 1];
+
+  /* exit and halt do not return, so count the call first. */
+  sc->call_cnt++;
+  start = rdtsc ();
+  sc->func (argv, f);
+  sc->cycles += rdtsc () - start;
+}
+
+/* Prints the number of calls to each system call that has been
+   used and the average number of CPU cycles that they took. */
+void
+syscall_print_stats (void)
+{
+  size_t i;
+
+  for (i = 0; i < SYSCALL_CNT; i++)
     {
-      if (!is_user_vaddr (args[1]))
-        exit_handler (-1);
-      f->eax = open_handler (args[1]);
+      struct syscall *sc = &syscalls[i];
+
+      if (sc->call_cnt > 0)
+        printf ("Syscall: %s: %lld calls, %llu cycles per call\n",
+                sc->name, sc->call_cnt, sc->cycles / sc->call_cnt);
     }
-  if (args[0] == SYS_FILESIZE)
-    f->eax = filesize_handler (args[1]);
-  if (args[0] == SYS_READ) 
-    {
-      check_pointer (args[2], args[3]);
-      f->eax = read_handler (args[1], args[2], args[3]);
-    } 
-  if (args[0] == SYS_SEEK)
-    seek_handler (args[1], args[2]);
-  if (args[0] == SYS_TELL)
-    f->eax = tell_handler (args[1]);
-  if (args[0] == SYS_CLOSE)
-    close_handler (args[1]);
-  if (args[0] == SYS_HALT) 
-    halt_handler ();
-  if (args[0] == SYS_EXEC) 
-    f->eax = exec_handler (args[1]);
-  if (args[0] == SYS_WAIT) 
-    f->eax = wait_handler (args[1]);
-  if (args[0] == SYS_PRACTICE) 
-    f->eax = practice_handler (args[1]);
-  if (args[0] == SYS_CACHEH)
-    f->eax = cacheh_handler ();
-  if (args[0] == SYS_CACHEM)
-    f->eax = cachem_handler ();
-  if (args[0] == SYS_BLOCKR)
-    f->eax = blockr_handler ();
-  if (args[0] == SYS_BLOCKW)
-    f->eax = blockw_handler ();
-  if (args[0] == SYS_CACHECLEAR)
-    cacheclear_handler ();
-  if (args[0] == SYS_CHDIR)
-    f->eax = chdir_handler (args[1]);
-  if (args[0] == SYS_MKDIR)
-    f->eax = mkdir_handler (args[1]);
-  if (args[0] == SYS_READDIR)
-    f->eax = readdir_handler (args[1], args[2]);
-  if (args[0] == SYS_ISDIR)
-    f->eax = isdir_handler (args[1]);
-  if (args[0] == SYS_INUMBER)
-    f->eax = inumber_handler (args[1]);
 }
 
 void
@@ -212,15 +451,11 @@ open_handler (const char *file)
       if (!success)
         return -1;
 
-      struct inode_disk *metadata;
-      uint8_t buffer[BLOCK_SECTOR_SIZE];
-      metadata = read_sector (new_i->sector, buffer);
-
       lock_acquire (&open_lock);
       struct file *new_file = NULL;
       struct dir *new_dir = NULL;
 
-      if (metadata->is_dir)
+      if (inode_is_dir (new_i))
         new_dir = dir_open (new_i);
       else
         new_file = file_open (new_i);
@@ -230,8 +465,15 @@ open_handler (const char *file)
       if (new_file == NULL && new_dir == NULL)
         return -1;
 
-      wrapper = palloc_get_page (0);
-      wrapper->is_dir = metadata->is_dir;
+      wrapper = malloc (sizeof *wrapper);
+      if (wrapper == NULL)
+        {
+          file_close (new_file);
+          dir_close (new_dir);
+          free (last_name);
+          return -1;
+        }
+      wrapper->is_dir = new_dir != NULL;
       wrapper->dir = new_dir;
       wrapper->file = new_file;
 
@@ -239,31 +481,32 @@ open_handler (const char *file)
     }
   else
     {
-      wrapper = palloc_get_page (0);
+      wrapper = malloc (sizeof *wrapper);
+      if (wrapper == NULL)
+        return -1;
       wrapper->is_dir = true;
       wrapper->dir = dir_open_root ();
       wrapper->file = NULL;
     } 
 
-  int i;
-  for (i = 2; i < 130; i++) 
+  int fd = fd_alloc (&thread_current ()->fds, wrapper);
+  if (fd == -1)
     {
-      if (thread_current ()->files[i] == NULL) 
-        {
-          thread_current ()->files[i] = wrapper;
-          return i;
-        }
+      lock_acquire (&close_lock);
+      if (wrapper->is_dir)
+        dir_close (wrapper->dir);
+      else
+        file_close (wrapper->file);
+      lock_release (&close_lock);
+      free (wrapper);
     }
-  return -1;
+  return fd;
 }
 
 int filesize_handler (int fd) 
 {
-  if (fd < 0 || fd >= 130 || fd == 1)
-    return -1;
-
   struct wrapper *w;
-  w = thread_current ()->files[fd];
+  w = fd_get (&thread_current ()->fds, fd);
   if (w == NULL || w->is_dir)
     return -1;
 
@@ -273,52 +516,46 @@ int filesize_handler (int fd)
   return size;
 }
 
+/* The buffer cache copies straight into and out of BUFFER, which
+   stays pinned for the duration. */
 int read_handler (int fd, void *buffer, unsigned size) 
 {
-  check_pointer (buffer, -1);
-  if (fd < 0 || fd >= 130 || fd == 1)
-    return -1;
+  int read = -1;
 
+  pin_buffer (buffer, size, true);
   struct wrapper *w;
-  w = thread_current ()->files[fd];
-  if (w == NULL || w->is_dir)
-    return -1;
-
-  struct file *f = w->file;
-
-  int read = file_read (f, buffer, size);
+  w = fd_get (&thread_current ()->fds, fd);
+  if (w != NULL && !w->is_dir)
+    read = file_read (w->file, buffer, size);
+  unpin_buffer (buffer, size);
   return read;
 }
 
 int write_handler (int fd, const void *buffer, unsigned size) 
 {
-  check_pointer (buffer, -1);
-  if (fd < 0 || fd >= 130 || fd == 0)
-    return -1;
-	else if (fd == 1) 
-    {
-  		putbuf (buffer, size);
-  		return size;
-  	}
-
-  struct wrapper *w;
-  w = thread_current ()->files[fd];
-  if (w == NULL || w->is_dir)
-    return -1;
+  int written = -1;
 
-  struct file *f = w->file;
-
-  int written = file_write (f, buffer, size);
+  pin_buffer (buffer, size, false);
+  if (fd == 1)
+    {
+      putbuf (buffer, size);
+      written = size;
+    }
+  else
+    {
+      struct wrapper *w;
+      w = fd_get (&thread_current ()->fds, fd);
+      if (w != NULL && !w->is_dir)
+        written = file_write (w->file, buffer, size);
+    }
+  unpin_buffer (buffer, size);
   return written;
 }
 
 void seek_handler (int fd, unsigned position) 
 {
-  if (fd <= 0 || fd >= 130)
-    return;
-
   struct wrapper *w;
-  w = thread_current ()->files[fd];
+  w = fd_get (&thread_current ()->fds, fd);
   if (w == NULL || w->is_dir)
     return;
 
@@ -329,11 +566,8 @@ void seek_handler (int fd, unsigned position)
 
 unsigned tell_handler(int fd) 
 {
-  if (fd <= 0 || fd >= 130) 
-    return -1;
-
   struct wrapper *w;
-  w = thread_current ()->files[fd];
+  w = fd_get (&thread_current ()->fds, fd);
   if (w == NULL || w->is_dir)
     return -1;
 
@@ -345,11 +579,8 @@ unsigned tell_handler(int fd)
 
 void close_handler(int fd) 
 {
-  if (fd <= 0 || fd >= 130 || fd == 1)
-    return;
-
   struct wrapper *w;
-  w = thread_current ()->files[fd];
+  w = fd_free (&thread_current ()->fds, fd);
   if (w == NULL)
     return;
   if (w->is_dir)
@@ -368,20 +599,113 @@ void close_handler(int fd)
       file_close (f);
       lock_release (&close_lock);
     }
-  thread_current ()->files[fd] = NULL;
+  free (w);
+}
+
+int
+readv_handler (int fd, const struct iovec *iov, int iovcnt)
+{
+  return transfer_vector (fd, iov, iovcnt, false);
+}
 
+int
+writev_handler (int fd, const struct iovec *iov, int iovcnt)
+{
+  return transfer_vector (fd, iov, iovcnt, true);
 }
 
+/* Carries out the operations queued on RING, as described in
+   <syscall-io.h>, and returns how many were carried out.  The
+   ring stays pinned meanwhile, so that posting completions
+   cannot fault. */
+int
+io_enter_handler (struct io_ring *ring)
+{
+  int done = 0;
+  int opened = -1;
+
+  pin_buffer (ring, sizeof *ring, true);
+  while (ring->sq_head != ring->sq_tail
+         && ring->cq_tail - ring->cq_head < IO_RING_ENTRIES)
+    {
+      struct io_sqe sqe = ring->sq[ring->sq_head % IO_RING_ENTRIES];
+      struct io_cqe *cqe = &ring->cq[ring->cq_tail % IO_RING_ENTRIES];
+      int fd = sqe.fd == IO_FD_PREV ? opened : sqe.fd;
+      int result;
+
+      switch (sqe.op)
+        {
+        case IO_OPEN:
+          result = open_handler (sqe.buf);
+          if (result >= 0)
+            opened = result;
+          break;
+        case IO_READ:
+          result = read_handler (fd, sqe.buf, sqe.len);
+          break;
+        case IO_WRITE:
+          result = write_handler (fd, sqe.buf, sqe.len);
+          break;
+        case IO_CLOSE:
+          close_handler (fd);
+          result = 0;
+          break;
+        default:
+          result = -1;
+          break;
+        }
+
+      cqe->user_data = sqe.user_data;
+      cqe->result = result;
+      ring->sq_head++;
+      ring->cq_tail++;
+      done++;
+    }
+  unpin_buffer (ring, sizeof *ring);
+  return done;
+}
+
+#ifdef VM
+int
+mmap_handler (int fd, void *addr)
+{
+  struct wrapper *w;
+  w = fd_get (&thread_current ()->fds, fd);
+  if (w == NULL || w->is_dir)
+    return MAP_FAILED;
+
+  return mmap_map (w->file, addr);
+}
+
+void
+munmap_handler (int mapping)
+{
+  mmap_unmap (mapping);
+}
+
+pid_t
+fork_handler (const struct intr_frame *f)
+{
+  return process_fork (f);
+}
+#endif
+
 int
 cacheh_handler (void)
 {
-  return cache_hits;
+  return cache_hit_cnt ();
 }
 
 int
 cachem_handler (void)
 {
-  return cache_misses;
+  return cache_miss_cnt ();
+}
+
+int
+cachep_handler (void)
+{
+  return cache_prefetch_hit_cnt ();
 }
 
 unsigned long long
@@ -501,8 +825,8 @@ readdir_handler (int fd, char name[NAME_MAX + 1])
   check_pointer (name, -1);
 
   struct wrapper *wrapper;
-  wrapper = thread_current ()->files[fd];
-  if (!wrapper->is_dir)
+  wrapper = fd_get (&thread_current ()->fds, fd);
+  if (wrapper == NULL || !wrapper->is_dir)
     return false;
   struct dir *dir = wrapper->dir;
   bool success;
@@ -517,15 +841,17 @@ bool
 isdir_handler (int fd)
 {
   struct wrapper *wrapper;
-  wrapper = thread_current ()->files[fd];
-  return wrapper->is_dir;
+  wrapper = fd_get (&thread_current ()->fds, fd);
+  return wrapper != NULL && wrapper->is_dir;
 }
 
 int 
 inumber_handler (int fd)
 {
   struct wrapper *wrapper;
-  wrapper = thread_current ()->files[fd];
+  wrapper = fd_get (&thread_current ()->fds, fd);
+  if (wrapper == NULL)
+    return -1;
   if (wrapper->is_dir)
     return inode_get_inumber (wrapper->dir->inode);
   else
@@ -536,22 +862,94 @@ inumber_handler (int fd)
 static void
 check_pointer (const void *vaddr, int buffer_size)
 {
+#ifdef VM
+  /* Pages that have not been touched yet are loaded here, and
+     the stack grows to cover a buffer on it. */
+  if (vaddr == NULL
+      || !page_fault_in (vaddr, thread_current ()->user_esp))
+      exit_handler (-1);
+#else
   if (vaddr == NULL || !is_user_vaddr (vaddr) 
                     || pagedir_get_page (thread_current ()->pagedir, vaddr) == NULL)
       exit_handler (-1);
+#endif
   else if (buffer_size != -1)
       check_buffer (vaddr, buffer_size);
 }
 
+/* Checks each page of the BUFFER_SIZE bytes at VADDR, whose
+   first byte has already been checked, once. */
 static void
 check_buffer (const void *vaddr, int buffer_size)
 {
+  const uint8_t *upage = pg_round_down (vaddr);
+  const uint8_t *last = (const uint8_t *) vaddr + buffer_size - 1;
+  const uint8_t *last_page = pg_round_down (last);
+
+  if (buffer_size <= 0)
+    return;
+  if (last < upage)
+    exit_handler (-1);
+  for (upage += PGSIZE; upage <= last_page; upage += PGSIZE)
+    check_pointer (upage, -1);
+}
+
+/* Makes sure that the SIZE bytes at user address BUFFER can be
+   read, or written if WRITE, by the kernel without faulting,
+   checking one page at a time, and terminates the process if
+   not.  With VM the pages are also pinned in memory until
+   unpin_buffer() is called, so that the file system can copy to
+   and from them while it holds its locks. */
+static void
+pin_buffer (const void *buffer, unsigned size, bool write UNUSED)
+{
+#ifdef VM
+  if (!page_pin_buffer (buffer, size, thread_current ()->user_esp, write))
+    exit_handler (-1);
+#else
+  check_pointer (buffer, size > 0 ? (int) size : -1);
+#endif
+}
+
+/* Reads from (if WRITE is false) or writes to file FD through
+   the IOVCNT buffers that IOV describes, in order, stopping at
+   the first short transfer.  Returns the number of bytes
+   transferred, or -1 if IOVCNT is out of range or nothing could
+   be transferred because FD is bad. */
+static int
+transfer_vector (int fd, const struct iovec *iov, int iovcnt, bool write)
+{
+  int total = 0;
   int i;
-  for (i = 0; i < buffer_size; i++)
+
+  if (iovcnt < 0 || iovcnt > IOV_MAX)
+    return -1;
+  if (iovcnt == 0)
+    return 0;
+  check_pointer (iov, iovcnt * sizeof *iov);
+
+  for (i = 0; i < iovcnt; i++)
     {
-      check_pointer (vaddr, -1);
-      vaddr++;
+      struct iovec v = iov[i];
+      int n = (write ? write_handler (fd, v.iov_base, v.iov_len)
+               : read_handler (fd, v.iov_base, v.iov_len));
+
+      if (n < 0)
+        return i == 0 ? -1 : total;
+      total += n;
+      if ((size_t) n < v.iov_len)
+        break;
     }
+  return total;
+}
+
+/* Releases the pages that pin_buffer() pinned. */
+static void
+unpin_buffer (const void *buffer UNUSED, unsigned size UNUSED)
+{
+#ifdef VM
+  page_unpin_buffer (buffer, size);
+#endif
 }
 
 int 
@@ -1,9 +1,13 @@
 #ifndef USERPROG_SYSCALL_H
 #define USERPROG_SYSCALL_H
 
+#include <syscall-io.h>
 #include "threads/thread.h"
 
+struct intr_frame;
+
 void syscall_init (void);
+void syscall_print_stats (void);
 
 struct wrapper
   {
@@ -20,6 +24,9 @@ int write_handler (int fd, const void *buffer, unsigned size);
 void seek_handler (int fd, unsigned position);
 unsigned tell_handler (int fd);
 void close_handler (int fd);
+int readv_handler (int fd, const struct iovec *, int iovcnt);
+int writev_handler (int fd, const struct iovec *, int iovcnt);
+int io_enter_handler (struct io_ring *);
 
 void halt_handler (void);
 int exec_handler (const char *cmd_line);
@@ -27,6 +34,7 @@ int wait_handler (pid_t pid);
 int practice_handler (int status);
 int cacheh_handler (void);
 int cachem_handler (void);
+int cachep_handler (void);
 unsigned long long blockr_handler (void);
 unsigned long long blockw_handler (void);
 void cacheclear_handler(void);
@@ -36,6 +44,11 @@ bool mkdir_handler (const char *dir);
 bool readdir_handler (int fd, char *name);
 bool isdir_handler (int fd);
 int inumber_handler (int fd);
+#ifdef VM
+int mmap_handler (int fd, void *addr);
+void munmap_handler (int mapping);
+pid_t fork_handler (const struct intr_frame *);
+#endif
 
 int last_occurrence (const char *str, char desired);
 #endif /* userprog/syscall.h */
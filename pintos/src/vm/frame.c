@@ -0,0 +1,249 @@
+#include "vm/frame.h"
+#include <debug.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "userprog/pagedir.h"
+#include "vm/page.h"
+#include "vm/pagecache.h"
+
+/* Every frame that holds a user page, in the order the clock
+   hand visits them. */
+static struct list frame_list;
+static struct list_elem *clock_hand;    /* Next frame to consider. */
+static struct lock frame_lock;          /* Protects the above. */
+
+/* Statistics. */
+static long long evict_cnt;             /* Number of pages evicted. */
+
+static struct frame *frame_get (void);
+static struct frame *frame_evict (void);
+
+/* Initializes the frame table. */
+void
+frame_init (void)
+{
+  list_init (&frame_list);
+  clock_hand = list_end (&frame_list);
+  lock_init (&frame_lock);
+}
+
+/* Obtains a frame for page P of the current process, evicting
+   another page if the user pool is exhausted.  The frame is
+   returned pinned, so that it cannot be evicted before P is
+   loaded into it; the caller should unpin it with frame_unpin()
+   once P is mapped.  Returns a null pointer if no frame can be
+   obtained. */
+struct frame *
+frame_alloc (struct page *p)
+{
+  struct frame *f = frame_get ();
+
+  if (f != NULL)
+    {
+      f->page = p;
+      f->fpage = NULL;
+      f->owner = thread_current ();
+    }
+  return f;
+}
+
+/* Obtains a frame for shared file page FP, as frame_alloc(). */
+struct frame *
+frame_alloc_shared (struct file_page *fp)
+{
+  struct frame *f = frame_get ();
+
+  if (f != NULL)
+    {
+      f->page = NULL;
+      f->fpage = fp;
+      f->owner = NULL;
+    }
+  return f;
+}
+
+/* Hands frame F, which holds a private page, over to shared page
+   FP.  The caller must hold the locks of both pages. */
+void
+frame_share (struct frame *f, struct file_page *fp)
+{
+  lock_acquire (&frame_lock);
+  f->page = NULL;
+  f->fpage = fp;
+  f->owner = NULL;
+  lock_release (&frame_lock);
+}
+
+/* Returns a pinned frame, either newly allocated or taken from
+   another page by eviction, or a null pointer if neither is
+   possible. */
+static struct frame *
+frame_get (void)
+{
+  struct frame *f;
+  void *kpage = palloc_get_page (PAL_USER);
+
+  if (kpage != NULL)
+    {
+      f = malloc (sizeof *f);
+      if (f == NULL)
+        {
+          palloc_free_page (kpage);
+          return NULL;
+        }
+      f->kpage = kpage;
+      f->pin_cnt = 1;
+      lock_acquire (&frame_lock);
+      list_push_back (&frame_list, &f->elem);
+      lock_release (&frame_lock);
+    }
+  else
+    f = frame_evict ();
+  return f;
+}
+
+/* Keeps frame F from being evicted until a matching call to
+   frame_unpin().  Pins nest, so that several processes may pin
+   the same shared frame.  The caller must hold the lock of the
+   page that F holds, so that F cannot be evicted meanwhile. */
+void
+frame_pin (struct frame *f)
+{
+  lock_acquire (&frame_lock);
+  f->pin_cnt++;
+  lock_release (&frame_lock);
+}
+
+/* Releases a pin on frame F, allowing it to be evicted again once
+   no pins remain. */
+void
+frame_unpin (struct frame *f)
+{
+  lock_acquire (&frame_lock);
+  ASSERT (f->pin_cnt > 0);
+  f->pin_cnt--;
+  lock_release (&frame_lock);
+}
+
+/* Removes frame F from the frame table and frees it.  The page
+   that F holds must already be unmapped. */
+void
+frame_free (struct frame *f)
+{
+  lock_acquire (&frame_lock);
+  if (clock_hand == &f->elem)
+    clock_hand = list_next (clock_hand);
+  list_remove (&f->elem);
+  lock_release (&frame_lock);
+
+  palloc_free_page (f->kpage);
+  free (f);
+}
+
+/* Prints frame table statistics. */
+void
+frame_print_stats (void)
+{
+  printf ("Frame: %lld evictions\n", evict_cnt);
+}
+
+/* Advances the clock hand and returns the frame it passed over.
+   frame_lock must be held and frame_list must not be empty. */
+static struct frame *
+clock_next (void)
+{
+  struct frame *f;
+
+  if (clock_hand == list_end (&frame_list))
+    clock_hand = list_begin (&frame_list);
+  f = list_entry (clock_hand, struct frame, elem);
+  clock_hand = list_next (clock_hand);
+  return f;
+}
+
+/* Tries to lock the page that frame F holds without waiting.
+   Returns true if successful. */
+static bool
+frame_try_lock (struct frame *f)
+{
+  return lock_try_acquire (f->page != NULL ? &f->page->lock
+                           : &f->fpage->lock);
+}
+
+/* Unlocks the page that frame F holds. */
+static void
+frame_unlock (struct frame *f)
+{
+  lock_release (f->page != NULL ? &f->page->lock : &f->fpage->lock);
+}
+
+/* Returns true if the page that frame F holds has been accessed
+   since the last call, and clears its accessed bits.  The page
+   must be locked. */
+static bool
+frame_accessed (struct frame *f)
+{
+  struct page *p = f->page;
+
+  if (p == NULL)
+    return pagecache_accessed (f->fpage);
+  if (!pagedir_is_accessed (f->owner->pagedir, p->upage))
+    return false;
+  pagedir_set_accessed (f->owner->pagedir, p->upage, false);
+  return true;
+}
+
+/* Chooses a frame with the second-chance clock algorithm, writes
+   the page that it holds out of memory, and returns the frame
+   pinned.  A frame whose page was accessed since the hand last
+   passed gets its accessed bit cleared and is skipped this time
+   around.  Returns a null pointer if every frame is pinned or
+   holds a page that cannot be written out. */
+static struct frame *
+frame_evict (void)
+{
+  size_t i;
+
+  lock_acquire (&frame_lock);
+  for (i = 0; i < 3 * list_size (&frame_list); i++)
+    {
+      struct frame *f = clock_next ();
+      bool evicted;
+
+      /* Lock order is page then frame_lock, so don't wait for
+         a page that is busy. */
+      if (f->pin_cnt > 0 || !frame_try_lock (f))
+        continue;
+      if (frame_accessed (f))
+        {
+          frame_unlock (f);
+          continue;
+        }
+
+      f->pin_cnt = 1;
+      lock_release (&frame_lock);
+      evicted = (f->page != NULL ? page_out (f->page)
+                 : pagecache_out (f->fpage));
+
+      /* Unpin a frame that could not be written out before
+         releasing its page, whose owner may free the frame as
+         soon as the page lock is free. */
+      lock_acquire (&frame_lock);
+      if (evicted)
+        evict_cnt++;
+      else
+        f->pin_cnt = 0;
+      frame_unlock (f);
+      if (evicted)
+        {
+          lock_release (&frame_lock);
+          return f;
+        }
+    }
+  lock_release (&frame_lock);
+  return NULL;
+}
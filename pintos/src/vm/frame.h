@@ -0,0 +1,33 @@
+#ifndef VM_FRAME_H
+#define VM_FRAME_H
+
+#include <list.h>
+#include <stdbool.h>
+
+struct page;
+struct file_page;
+
+/* A frame of physical memory from the user pool that holds a
+   user page.  The page is either private to one process, or a
+   page of a mapped file or a copy-on-write page that may be
+   shared by several. */
+struct frame
+  {
+    struct list_elem elem;              /* Element in frame list. */
+    void *kpage;                        /* Kernel virtual address. */
+    struct page *page;                  /* Private page, or null. */
+    struct file_page *fpage;            /* Shared file page, or null. */
+    struct thread *owner;               /* Process that owns PAGE. */
+    int pin_cnt;                        /* Not to be evicted if nonzero. */
+  };
+
+void frame_init (void);
+struct frame *frame_alloc (struct page *);
+struct frame *frame_alloc_shared (struct file_page *);
+void frame_share (struct frame *, struct file_page *);
+void frame_pin (struct frame *);
+void frame_unpin (struct frame *);
+void frame_free (struct frame *);
+void frame_print_stats (void);
+
+#endif /* vm/frame.h */
@@ -0,0 +1,140 @@
+#include "vm/mmap.h"
+#include <debug.h>
+#include <round.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "vm/page.h"
+#include "vm/pagecache.h"
+
+static void unmap (struct mapping *);
+
+/* Maps FILE into the current process's address space starting at
+   user page ADDR.  Pages are read from the file when first
+   touched, and modified pages are written back to it when they
+   are unmapped.  Processes that map the same file share its
+   pages.  Returns the new mapping's identifier, or MAP_FAILED if
+   FILE is empty, ADDR is not a page-aligned, nonzero user
+   address, the mapping would overlap pages already in use, or
+   memory allocation fails.  The region that the stack may grow
+   into counts as in use. */
+mapid_t
+mmap_map (struct file *file, void *addr)
+{
+  struct thread *t = thread_current ();
+  struct inode *inode = file_get_inode (file);
+  off_t length = file_length (file);
+  size_t page_cnt = DIV_ROUND_UP (length, PGSIZE);
+  struct mapping *m;
+  size_t i;
+
+  if (addr == NULL || pg_ofs (addr) != 0 || length == 0)
+    return MAP_FAILED;
+
+  m = malloc (sizeof *m);
+  if (m == NULL)
+    return MAP_FAILED;
+  m->id = t->next_mapid++;
+  m->addr = addr;
+  m->page_cnt = 0;
+
+  for (i = 0; i < page_cnt; i++)
+    {
+      uint8_t *upage = (uint8_t *) addr + i * PGSIZE;
+      off_t ofs = i * PGSIZE;
+      size_t read_bytes = length - ofs < PGSIZE ? length - ofs : PGSIZE;
+      struct file_page *fp;
+
+      if (upage >= (uint8_t *) PHYS_BASE - page_stack_limit
+          || page_lookup (upage) != NULL)
+        break;
+      fp = pagecache_get (inode, ofs, read_bytes, false);
+      if (fp == NULL)
+        break;
+      if (!page_add_mmap (upage, fp, true))
+        {
+          pagecache_put (fp);
+          break;
+        }
+      m->page_cnt++;
+    }
+
+  if (m->page_cnt != page_cnt)
+    {
+      unmap (m);
+      return MAP_FAILED;
+    }
+  list_push_back (&t->mappings, &m->elem);
+  return m->id;
+}
+
+/* Removes the current process's mapping MAPID, if it exists,
+   writing modified pages back to the file. */
+void
+mmap_unmap (mapid_t mapid)
+{
+  struct thread *t = thread_current ();
+  struct list_elem *e;
+
+  for (e = list_begin (&t->mappings); e != list_end (&t->mappings);
+       e = list_next (e))
+    {
+      struct mapping *m = list_entry (e, struct mapping, elem);
+      if (m->id == mapid)
+        {
+          list_remove (&m->elem);
+          unmap (m);
+          return;
+        }
+    }
+}
+
+/* Removes all of the current process's mappings, writing
+   modified pages back to their files. */
+void
+mmap_unmap_all (void)
+{
+  struct thread *t = thread_current ();
+
+  while (!list_empty (&t->mappings))
+    unmap (list_entry (list_pop_front (&t->mappings),
+                       struct mapping, elem));
+}
+
+/* Gives the current process the same mappings as PARENT, for
+   fork().  The pages themselves must already have been copied
+   with page_table_copy().  Returns false if memory allocation
+   fails. */
+bool
+mmap_copy (struct thread *parent)
+{
+  struct thread *t = thread_current ();
+  struct list_elem *e;
+
+  for (e = list_begin (&parent->mappings); e != list_end (&parent->mappings);
+       e = list_next (e))
+    {
+      struct mapping *pm = list_entry (e, struct mapping, elem);
+      struct mapping *m = malloc (sizeof *m);
+
+      if (m == NULL)
+        return false;
+      *m = *pm;
+      list_push_back (&t->mappings, &m->elem);
+    }
+  t->next_mapid = parent->next_mapid;
+  return true;
+}
+
+/* Removes M's pages from the current process's address space and
+   frees M. */
+static void
+unmap (struct mapping *m)
+{
+  size_t i;
+
+  for (i = 0; i < m->page_cnt; i++)
+    page_remove (page_lookup ((uint8_t *) m->addr + i * PGSIZE));
+  free (m);
+}
@@ -0,0 +1,28 @@
+#ifndef VM_MMAP_H
+#define VM_MMAP_H
+
+#include <list.h>
+#include <stdbool.h>
+
+struct file;
+struct thread;
+
+/* Map region identifier. */
+typedef int mapid_t;
+#define MAP_FAILED ((mapid_t) -1)
+
+/* A file mapped into a process's address space with mmap(). */
+struct mapping
+  {
+    struct list_elem elem;              /* Element in thread's mappings. */
+    mapid_t id;                         /* Mapping identifier. */
+    void *addr;                         /* First mapped user page. */
+    size_t page_cnt;                    /* Number of pages mapped. */
+  };
+
+mapid_t mmap_map (struct file *, void *addr);
+void mmap_unmap (mapid_t);
+void mmap_unmap_all (void);
+bool mmap_copy (struct thread *parent);
+
+#endif /* vm/mmap.h */
@@ -0,0 +1,576 @@
+#include "vm/page.h"
+#include <debug.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/frame.h"
+#include "vm/pagecache.h"
+#include "vm/swap.h"
+
+size_t page_stack_limit = STACK_DEFAULT_LIMIT;
+
+static hash_hash_func page_hash;
+static hash_less_func page_less;
+static hash_action_func page_free;
+static bool copy_page (struct page *, struct file *executable);
+static bool pin (const void *addr, const void *esp, bool write);
+static void unpin (const void *addr);
+
+/* Returns true if page P's frame belongs to a file_page. */
+static inline bool
+is_shared (const struct page *p)
+{
+  return p->type == PAGE_MMAP || p->type == PAGE_TEXT || p->type == PAGE_COW;
+}
+
+/* Initializes PAGES as an empty supplemental page table.
+   Returns false if memory allocation fails. */
+bool
+page_table_init (struct hash *pages)
+{
+  return hash_init (pages, page_hash, page_less, NULL);
+}
+
+/* Fills the current process's supplemental page table, which
+   must be empty, with a copy of PARENT's address space, for
+   fork().  Pages that PARENT has in memory or in swap are shared
+   copy-on-write, mapped files are shared outright, and pages
+   that PARENT has never touched are read again from EXECUTABLE,
+   the current process's copy of PARENT's executable, when they
+   are.  PARENT must not run meanwhile.  Returns false if memory
+   allocation fails, in which case the table may be partly
+   filled. */
+bool
+page_table_copy (struct thread *parent, struct file *executable)
+{
+  struct hash_iterator i;
+
+  hash_first (&i, &parent->pages);
+  while (hash_next (&i))
+    {
+      struct page *p = hash_entry (hash_cur (&i), struct page, hash_elem);
+      bool success;
+
+      /* Keep P's frame from being evicted while it is shared. */
+      lock_acquire (&p->lock);
+      success = copy_page (p, executable);
+      lock_release (&p->lock);
+      if (!success)
+        return false;
+    }
+  return true;
+}
+
+/* Frees every entry in supplemental page table PAGES, which
+   must belong to the current process, along with the table
+   itself, the frames and the swap slots that its pages occupy.
+   Must be called before the process's page directory is
+   destroyed. */
+void
+page_table_destroy (struct hash *pages)
+{
+  hash_destroy (pages, page_free);
+}
+
+/* Adds a new page with the given attributes to the current
+   process's supplemental page table.  Returns false if UPAGE is
+   already in the table or if memory allocation fails. */
+static struct page *
+page_add (void *upage, enum page_type type, bool writable)
+{
+  struct page *p;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (is_user_vaddr (upage));
+
+  p = malloc (sizeof *p);
+  if (p == NULL)
+    return NULL;
+  p->upage = upage;
+  p->owner = thread_current ();
+  p->type = type;
+  p->writable = writable;
+  p->file = NULL;
+  p->ofs = 0;
+  p->read_bytes = 0;
+  p->fpage = NULL;
+  lock_init (&p->lock);
+  p->frame = NULL;
+  p->swap_slot = SWAP_NONE;
+  if (hash_insert (&thread_current ()->pages, &p->hash_elem) != NULL)
+    {
+      free (p);
+      return NULL;
+    }
+  return p;
+}
+
+/* Records that user page UPAGE is to be loaded on first touch
+   with READ_BYTES bytes from FILE starting at offset OFS,
+   followed by PGSIZE - READ_BYTES zero bytes.  Returns true if
+   successful, false if UPAGE is already in use or memory
+   allocation fails. */
+bool
+page_add_file (void *upage, struct file *file, off_t ofs,
+               size_t read_bytes, bool writable)
+{
+  struct page *p;
+
+  ASSERT (read_bytes <= PGSIZE);
+
+  if (read_bytes == 0)
+    return page_add_zero (upage, writable);
+
+  p = page_add (upage, PAGE_FILE, writable);
+  if (p == NULL)
+    return false;
+  p->file = file;
+  p->ofs = ofs;
+  p->read_bytes = read_bytes;
+  return true;
+}
+
+/* Records that user page UPAGE is to be zeroed on first touch.
+   Returns true if successful, false if UPAGE is already in use
+   or memory allocation fails. */
+bool
+page_add_zero (void *upage, bool writable)
+{
+  return page_add (upage, PAGE_ZERO, writable) != NULL;
+}
+
+/* Records that user page UPAGE maps shared file page FP,
+   transferring the caller's reference to FP to the new page.
+   Returns true if successful, false if UPAGE is already in use
+   or memory allocation fails; the caller keeps its reference in
+   that case. */
+bool
+page_add_mmap (void *upage, struct file_page *fp, bool writable)
+{
+  struct page *p = page_add (upage, PAGE_MMAP, writable);
+
+  if (p == NULL)
+    return false;
+  p->fpage = fp;
+  return true;
+}
+
+/* Records that user page UPAGE maps file page FP, a page of the
+   process's executable, read-only, transferring the caller's
+   reference to FP to the new page.  Returns true if successful,
+   false if UPAGE is already in use or memory allocation fails;
+   the caller keeps its reference in that case. */
+bool
+page_add_text (void *upage, struct file_page *fp)
+{
+  struct page *p = page_add (upage, PAGE_TEXT, false);
+
+  if (p == NULL)
+    return false;
+  p->fpage = fp;
+  return true;
+}
+
+/* Records that user page UPAGE is shared copy-on-write through
+   anonymous file page FP, transferring the caller's reference to
+   FP to the new page.  Returns true if successful, false if
+   UPAGE is already in use or memory allocation fails; the caller
+   keeps its reference in that case. */
+bool
+page_add_cow (void *upage, struct file_page *fp, bool writable)
+{
+  struct page *p = page_add (upage, PAGE_COW, writable);
+
+  if (p == NULL)
+    return false;
+  p->fpage = fp;
+  return true;
+}
+
+/* Removes page P from the current process's supplemental page
+   table and frees it, writing it back first if it is a modified
+   page of a mapped file. */
+void
+page_remove (struct page *p)
+{
+  hash_delete (&thread_current ()->pages, &p->hash_elem);
+  page_free (&p->hash_elem, NULL);
+}
+
+/* Returns the current process's page that contains user virtual
+   address UPAGE, or a null pointer if there is none. */
+struct page *
+page_lookup (const void *upage)
+{
+  struct page p;
+  struct hash_elem *e;
+
+  p.upage = pg_round_down (upage);
+  e = hash_find (&thread_current ()->pages, &p.hash_elem);
+  return e != NULL ? hash_entry (e, struct page, hash_elem) : NULL;
+}
+
+/* Makes sure that the page containing user virtual address ADDR
+   is present in the current process's page directory, bringing
+   it in from swap or from its source if it is not.  Returns true
+   if the page is present, false if ADDR is not part of the
+   process's address space or no frame can be found for it. */
+bool
+page_load (const void *addr)
+{
+  struct thread *t = thread_current ();
+  struct page *p;
+  struct frame *f;
+  bool from_swap = false;
+  bool success = false;
+
+  if (!is_user_vaddr (addr))
+    return false;
+  if (pagedir_get_page (t->pagedir, addr) != NULL)
+    return true;
+  p = page_lookup (addr);
+  if (p == NULL)
+    return false;
+
+  lock_acquire (&p->lock);
+  if (is_shared (p))
+    {
+      success = pagecache_map (p->fpage, p);
+      goto done;
+    }
+  if (p->frame != NULL)
+    {
+      success = true;
+      goto done;
+    }
+
+  f = frame_alloc (p);
+  if (f == NULL)
+    goto done;
+
+  if (p->swap_slot != SWAP_NONE)
+    {
+      swap_in (p->swap_slot, f->kpage);
+      p->swap_slot = SWAP_NONE;
+      from_swap = true;
+    }
+  else if (p->type == PAGE_FILE)
+    {
+      if (file_read_at (p->file, f->kpage, p->read_bytes, p->ofs)
+          != (off_t) p->read_bytes)
+        {
+          frame_free (f);
+          goto done;
+        }
+      memset ((uint8_t *) f->kpage + p->read_bytes, 0,
+              PGSIZE - p->read_bytes);
+    }
+  else
+    memset (f->kpage, 0, PGSIZE);
+
+  if (!pagedir_set_page (t->pagedir, p->upage, f->kpage, p->writable))
+    {
+      /* The page's contents are lost if it came from swap, but
+         then so is the process, which is about to be killed. */
+      frame_free (f);
+      goto done;
+    }
+
+  /* The copy in swap is gone, so a page that came from there
+     has to go back there if it is evicted again. */
+  if (from_swap)
+    pagedir_set_dirty (t->pagedir, p->upage, true);
+  p->frame = f;
+  frame_unpin (f);
+  success = true;
+
+ done:
+  lock_release (&p->lock);
+  return success;
+}
+
+/* Returns true if ADDR may be an access to the stack by a
+   process whose stack pointer is ESP: it must lie within the
+   stack limit below PHYS_BASE, and no further below ESP than
+   the 32 bytes that PUSHA pushes before it updates the stack
+   pointer. */
+static bool
+is_stack_access (const void *addr, const void *esp)
+{
+  const uint8_t *a = addr;
+
+  return (esp != NULL && a < (uint8_t *) PHYS_BASE
+          && a >= (uint8_t *) PHYS_BASE - page_stack_limit
+          && a + 32 >= (uint8_t *) esp);
+}
+
+/* Like page_load(), but if ADDR is not part of the current
+   process's address space and looks like an access to its stack,
+   whose pointer is ESP, first grows the stack down to cover
+   ADDR with a new zero page. */
+bool
+page_fault_in (const void *addr, const void *esp)
+{
+  if (is_user_vaddr (addr) && page_lookup (addr) == NULL
+      && is_stack_access (addr, esp))
+    page_add_zero (pg_round_down (addr), true);
+  return page_load (addr);
+}
+
+/* Handles a write to the current process's page at user virtual
+   address ADDR, which is mapped read-only, by giving the process
+   its own copy of the page if it is a writable PAGE_COW page.
+   Returns true if the write can be retried, false if it is a
+   real protection violation or no frame is available. */
+bool
+page_unshare (const void *addr)
+{
+  struct thread *t = thread_current ();
+  struct page *p = page_lookup (addr);
+  struct file_page *fp;
+  struct frame *f;
+  bool success = false;
+
+  if (p == NULL || !p->writable)
+    return false;
+
+  lock_acquire (&p->lock);
+  if (p->type != PAGE_COW)
+    goto done;
+  fp = p->fpage;
+
+  f = frame_alloc (p);
+  if (f == NULL)
+    goto done;
+  if (!pagecache_copy (fp, p, f->kpage)
+      || !pagedir_set_page (t->pagedir, p->upage, f->kpage, true))
+    {
+      frame_free (f);
+      goto done;
+    }
+  pagecache_put (fp);
+  p->type = PAGE_ANON;
+  p->fpage = NULL;
+  p->frame = f;
+  frame_unpin (f);
+  success = true;
+
+ done:
+  lock_release (&p->lock);
+  return success;
+}
+
+/* Brings every page of the SIZE bytes at user virtual address
+   BUFFER into memory and pins it there until page_unpin_buffer(),
+   so that the kernel can access BUFFER directly while it holds
+   locks that a page fault might need.  The pages are checked one
+   at a time, not byte by byte.  If WRITE, they must be writable,
+   and shared copy-on-write pages are copied first.  ESP is the
+   process's user stack pointer, for growing the stack.  At least
+   the first byte of BUFFER is checked even if SIZE is 0.
+   Returns true if successful, false, with nothing pinned, if
+   BUFFER is not entirely part of the current process's address
+   space or no frame can be found for it. */
+bool
+page_pin_buffer (const void *buffer, size_t size, const void *esp,
+                 bool write)
+{
+  const uint8_t *first = pg_round_down (buffer);
+  const uint8_t *last = pg_round_down ((const uint8_t *) buffer
+                                       + (size > 0 ? size - 1 : 0));
+  const uint8_t *upage;
+
+  if (last < first)
+    return false;
+  for (upage = first; upage <= last; upage += PGSIZE)
+    if (!pin (upage == first ? buffer : upage, esp, write))
+      {
+        while (upage > first)
+          unpin (upage -= PGSIZE);
+        return false;
+      }
+  return true;
+}
+
+/* Releases the pins that page_pin_buffer() placed on the pages of
+   the SIZE bytes at BUFFER. */
+void
+page_unpin_buffer (const void *buffer, size_t size)
+{
+  const uint8_t *upage = pg_round_down (buffer);
+  const uint8_t *last = pg_round_down ((const uint8_t *) buffer
+                                       + (size > 0 ? size - 1 : 0));
+
+  for (; upage <= last; upage += PGSIZE)
+    unpin (upage);
+}
+
+/* Evicts page P, which must be in a frame and locked by the
+   caller, from memory.  P is written to swap if it has been
+   modified or is a PAGE_ANON page; otherwise it can be brought
+   back from its source.
+   Returns true if successful, false, leaving P mapped, if P had
+   to be written to swap but no swap slot is free. */
+bool
+page_out (struct page *p)
+{
+  struct frame *f = p->frame;
+  uint32_t *pd = f->owner->pagedir;
+
+  ASSERT (lock_held_by_current_thread (&p->lock));
+  ASSERT (!is_shared (p));
+
+  /* Unmap P first, so that the process cannot modify it while
+     it is written out.  The PTE keeps its dirty bit. */
+  pagedir_clear_page (pd, p->upage);
+  if (p->type == PAGE_ANON || pagedir_is_dirty (pd, p->upage))
+    {
+      p->swap_slot = swap_out (f->kpage);
+      if (p->swap_slot == SWAP_NONE)
+        {
+          pagedir_set_page (pd, p->upage, f->kpage, p->writable);
+          pagedir_set_dirty (pd, p->upage, true);
+          return false;
+        }
+    }
+  p->frame = NULL;
+  return true;
+}
+
+/* Returns a hash value for the page that E refers to. */
+static unsigned
+page_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct page *p = hash_entry (e, struct page, hash_elem);
+  return hash_bytes (&p->upage, sizeof p->upage);
+}
+
+/* Returns true if page A precedes page B. */
+static bool
+page_less (const struct hash_elem *a_, const struct hash_elem *b_,
+           void *aux UNUSED)
+{
+  const struct page *a = hash_entry (a_, struct page, hash_elem);
+  const struct page *b = hash_entry (b_, struct page, hash_elem);
+
+  return a->upage < b->upage;
+}
+
+/* Frees the page that E refers to, along with its frame or swap
+   slot. */
+static void
+page_free (struct hash_elem *e, void *aux UNUSED)
+{
+  struct page *p = hash_entry (e, struct page, hash_elem);
+
+  /* Wait for any eviction of P in progress. */
+  lock_acquire (&p->lock);
+  if (is_shared (p))
+    {
+      pagecache_unmap (p->fpage, p);
+      pagecache_put (p->fpage);
+    }
+  else if (p->frame != NULL)
+    {
+      pagedir_clear_page (thread_current ()->pagedir, p->upage);
+      frame_free (p->frame);
+    }
+  if (p->swap_slot != SWAP_NONE)
+    swap_free (p->swap_slot);
+  lock_release (&p->lock);
+  free (p);
+}
+
+/* Pins the frame of the current process's page that contains
+   ADDR, as described for page_pin_buffer(). */
+static bool
+pin (const void *addr, const void *esp, bool write)
+{
+  uint32_t *pd = thread_current ()->pagedir;
+
+  for (;;)
+    {
+      struct page *p;
+      bool pinned = false;
+
+      if (!page_fault_in (addr, esp))
+        return false;
+      p = page_lookup (addr);
+      if (write && !p->writable)
+        return false;
+      if (write && p->type == PAGE_COW && !page_unshare (addr))
+        return false;
+
+      /* The page may have been evicted again since it was
+         brought in, in which case we go around again.  Holding
+         its lock keeps it from being evicted while it is
+         pinned. */
+      lock_acquire (&p->lock);
+      if (!is_shared (p))
+        {
+          if (p->frame != NULL)
+            {
+              frame_pin (p->frame);
+              pinned = true;
+            }
+        }
+      else
+        {
+          lock_acquire (&p->fpage->lock);
+          if (pagedir_get_page (pd, p->upage) != NULL)
+            {
+              frame_pin (p->fpage->frame);
+              pinned = true;
+            }
+          lock_release (&p->fpage->lock);
+        }
+      lock_release (&p->lock);
+      if (pinned)
+        return true;
+    }
+}
+
+/* Releases a pin on the frame of the current process's page that
+   contains ADDR.  The frame cannot have changed, because it is
+   pinned. */
+static void
+unpin (const void *addr)
+{
+  struct page *p = page_lookup (addr);
+
+  frame_unpin (is_shared (p) ? p->fpage->frame : p->frame);
+}
+
+/* Adds a copy of PARENT's page P, which the caller must hold
+   locked, to the current process's supplemental page table, as
+   described for page_table_copy(). */
+static bool
+copy_page (struct page *p, struct file *executable)
+{
+  struct page *c;
+
+  if (!is_shared (p))
+    {
+      if (p->frame == NULL && p->swap_slot == SWAP_NONE)
+        {
+          /* Never touched, so nothing to share.  A PAGE_FILE
+             page's file is always its process's executable. */
+          if (p->type == PAGE_FILE)
+            return page_add_file (p->upage, executable, p->ofs,
+                                  p->read_bytes, p->writable);
+          return page_add_zero (p->upage, p->writable);
+        }
+      if (!pagecache_share (p))
+        return false;
+    }
+
+  c = page_add (p->upage, p->type, p->writable);
+  if (c == NULL)
+    return false;
+  c->fpage = p->fpage;
+  pagecache_ref (p->fpage);
+  return true;
+}
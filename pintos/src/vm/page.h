@@ -0,0 +1,96 @@
+#ifndef VM_PAGE_H
+#define VM_PAGE_H
+
+#include <hash.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "filesys/off_t.h"
+#include "threads/synch.h"
+
+struct thread;
+
+/* Default limit on the size of a user stack, in bytes. */
+#define STACK_DEFAULT_LIMIT (8 * 1024 * 1024)
+
+/* Largest limit that -stack=KB accepts, in bytes. */
+#define STACK_MAX_LIMIT (1024 * 1024 * 1024)
+
+/* Maximum size of a user stack, in bytes.  Set with the kernel's
+   -stack=KB option. */
+extern size_t page_stack_limit;
+
+/* Where a page's initial contents come from. */
+enum page_type
+  {
+    PAGE_FILE,                  /* Read from a file, zero the rest. */
+    PAGE_ZERO,                  /* All zeros. */
+    PAGE_MMAP,                  /* Shared page of a mapped file. */
+    PAGE_TEXT,                  /* Shared read-only executable page. */
+    PAGE_COW,                   /* Shared with fork()ed processes. */
+    PAGE_ANON                   /* Private copy of a PAGE_COW page. */
+  };
+
+/* A page of a process's virtual address space, as recorded in
+   its supplemental page table.  Pages are added to the table
+   when a process is loaded but only brought into memory when
+   the process first touches them.
+
+   A page is in a frame, in a swap slot, or in neither, in which
+   case it is read again from its source the next time it is
+   touched.  A page that has been written goes to swap when it is
+   evicted, whatever its source.
+
+   A PAGE_MMAP page is different: its frame belongs to a
+   file_page shared by every process that maps the same page of
+   the file, and it is written back to the file rather than to
+   swap.  Its frame and swap_slot members are unused.  So are a
+   PAGE_TEXT page's, which shares a read-only page of an
+   executable with every process running it, and a
+   PAGE_COW page, whose file_page is anonymous and shared by a
+   process and the children it has fork()ed.  A PAGE_COW page is
+   mapped read-only, and the first write to it replaces it with
+   a PAGE_ANON page holding a private copy, which has no source
+   to read it back from and so always goes to swap. */
+struct page
+  {
+    struct hash_elem hash_elem;         /* Element in thread's pages. */
+    void *upage;                        /* User virtual address. */
+    struct thread *owner;               /* Process that owns the page. */
+    enum page_type type;                /* Source of initial contents. */
+    bool writable;                      /* Writable by the process? */
+
+    struct lock lock;                   /* Protects frame, swap_slot. */
+    struct frame *frame;                /* Frame, if in memory. */
+    size_t swap_slot;                   /* Swap slot, or SWAP_NONE. */
+
+    /* PAGE_FILE only. */
+    struct file *file;                  /* File to read from. */
+    off_t ofs;                          /* Offset in FILE. */
+    size_t read_bytes;                  /* Bytes to read, rest zeroed. */
+
+    /* PAGE_MMAP, PAGE_TEXT and PAGE_COW only. */
+    struct file_page *fpage;            /* Shared file page. */
+    struct list_elem mapper_elem;       /* Element in fpage's mappers. */
+  };
+
+bool page_table_init (struct hash *);
+bool page_table_copy (struct thread *parent, struct file *executable);
+void page_table_destroy (struct hash *);
+
+bool page_add_file (void *upage, struct file *, off_t ofs,
+                    size_t read_bytes, bool writable);
+bool page_add_zero (void *upage, bool writable);
+bool page_add_mmap (void *upage, struct file_page *, bool writable);
+bool page_add_text (void *upage, struct file_page *);
+bool page_add_cow (void *upage, struct file_page *, bool writable);
+void page_remove (struct page *);
+struct page *page_lookup (const void *upage);
+bool page_load (const void *addr);
+bool page_fault_in (const void *addr, const void *esp);
+bool page_unshare (const void *addr);
+bool page_pin_buffer (const void *, size_t, const void *esp, bool write);
+void page_unpin_buffer (const void *, size_t);
+bool page_out (struct page *);
+
+#endif /* vm/page.h */
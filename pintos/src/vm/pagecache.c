@@ -0,0 +1,433 @@
+#include "vm/pagecache.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/frame.h"
+#include "vm/page.h"
+#include "vm/swap.h"
+
+/* Mapped file pages, indexed by inode, offset and length. */
+static struct hash file_pages;
+static struct lock cache_lock;  /* Protects file_pages, ref_cnt. */
+
+/* Statistics. */
+static long long map_cnt;       /* Number of pages mapped. */
+static long long shared_cnt;    /* Mapped pages that were in memory. */
+
+static hash_hash_func file_page_hash;
+static hash_less_func file_page_less;
+static struct file_page *file_page_create (struct inode *, off_t ofs,
+                                           size_t read_bytes);
+static bool load (struct file_page *);
+static void remove_mapping (struct file_page *, struct page *);
+static void write_back (struct file_page *);
+
+/* Initializes the page cache. */
+void
+pagecache_init (void)
+{
+  if (!hash_init (&file_pages, file_page_hash, file_page_less, NULL))
+    PANIC ("page cache creation failed");
+  lock_init (&cache_lock);
+}
+
+/* Returns the file_page for the page of INODE at offset OFS
+   that holds READ_BYTES bytes from INODE with the rest zeroed,
+   creating it if there is none, with a new reference to it.  A
+   page of an executable whose segment ends partway through it
+   does not share a file_page with a mapping of the whole page.
+
+   TEXT selects the read-only pages of running executables,
+   which are kept apart from mmap()ed pages of the same file.
+   Otherwise a process that mapped an executable writable could
+   change the code of every process running it.  Returns a null
+   pointer if memory allocation fails. */
+struct file_page *
+pagecache_get (struct inode *inode, off_t ofs, size_t read_bytes,
+               bool text)
+{
+  struct file_page key, *fp;
+  struct hash_elem *e;
+
+  ASSERT (ofs % PGSIZE == 0);
+  ASSERT (read_bytes <= PGSIZE);
+
+  key.inode = inode;
+  key.ofs = ofs;
+  key.read_bytes = read_bytes;
+  key.text = text;
+
+  lock_acquire (&cache_lock);
+  e = hash_find (&file_pages, &key.hash_elem);
+  if (e != NULL)
+    fp = hash_entry (e, struct file_page, hash_elem);
+  else
+    {
+      fp = file_page_create (inode_reopen (inode), ofs, read_bytes);
+      if (fp != NULL)
+        {
+          fp->text = text;
+          hash_insert (&file_pages, &fp->hash_elem);
+        }
+    }
+  if (fp != NULL)
+    fp->ref_cnt++;
+  lock_release (&cache_lock);
+
+  return fp;
+}
+
+/* Turns private page P, which the caller must hold locked and
+   which must be in a frame or in swap, into an anonymous page
+   shared copy-on-write.  P's frame or swap slot passes to a new
+   file_page, with P's reference to it, and P is unmapped until
+   it next faults.  Returns false, leaving P unchanged, if memory
+   allocation fails. */
+bool
+pagecache_share (struct page *p)
+{
+  struct file_page *fp;
+
+  ASSERT (lock_held_by_current_thread (&p->lock));
+  ASSERT (p->frame != NULL || p->swap_slot != SWAP_NONE);
+
+  fp = file_page_create (NULL, 0, PGSIZE);
+  if (fp == NULL)
+    return false;
+  fp->ref_cnt = 1;
+
+  /* Unmap P before the frame changes hands, since the frame
+     table only unmaps pages that are on FP's mappers list. */
+  lock_acquire (&fp->lock);
+  fp->swap_slot = p->swap_slot;
+  p->swap_slot = SWAP_NONE;
+  if (p->frame != NULL)
+    {
+      pagedir_clear_page (p->owner->pagedir, p->upage);
+      fp->frame = p->frame;
+      frame_share (p->frame, fp);
+      p->frame = NULL;
+    }
+  lock_release (&fp->lock);
+  p->type = PAGE_COW;
+  p->fpage = fp;
+  return true;
+}
+
+/* Adds a reference to FP, which the caller must already hold a
+   reference to. */
+void
+pagecache_ref (struct file_page *fp)
+{
+  lock_acquire (&cache_lock);
+  ASSERT (fp->ref_cnt > 0);
+  fp->ref_cnt++;
+  lock_release (&cache_lock);
+}
+
+/* Releases a reference to FP.  When the last reference goes
+   away, FP is written back if it is dirty and then freed along
+   with its frame. */
+void
+pagecache_put (struct file_page *fp)
+{
+  bool last;
+
+  lock_acquire (&cache_lock);
+  last = --fp->ref_cnt == 0;
+  if (last && fp->inode != NULL)
+    hash_delete (&file_pages, &fp->hash_elem);
+  lock_release (&cache_lock);
+  if (!last)
+    return;
+
+  /* Nothing can find FP any more except the frame table, which
+     only touches FP with its lock held. */
+  lock_acquire (&fp->lock);
+  ASSERT (list_empty (&fp->mappers));
+  if (fp->frame != NULL)
+    {
+      write_back (fp);
+      frame_free (fp->frame);
+    }
+  if (fp->swap_slot != SWAP_NONE)
+    swap_free (fp->swap_slot);
+  lock_release (&fp->lock);
+
+  inode_close (fp->inode);
+  free (fp);
+}
+
+/* Maps FP into its owner's page directory at page P, which the
+   caller must hold locked, reading FP into a frame first if it
+   is not already in memory.  Anonymous pages are mapped
+   read-only, whether or not P is writable.  Returns true if
+   successful, false if no frame is available. */
+bool
+pagecache_map (struct file_page *fp, struct page *p)
+{
+  uint32_t *pd = p->owner->pagedir;
+  bool success = false;
+
+  lock_acquire (&fp->lock);
+  if (pagedir_get_page (pd, p->upage) != NULL)
+    success = true;
+  else
+    {
+      bool in_memory = fp->frame != NULL;
+
+      if (load (fp)
+          && pagedir_set_page (pd, p->upage, fp->frame->kpage,
+                               p->writable && fp->inode != NULL))
+        {
+          list_push_back (&fp->mappers, &p->mapper_elem);
+          map_cnt++;
+          if (in_memory)
+            shared_cnt++;
+          success = true;
+        }
+    }
+  lock_release (&fp->lock);
+  return success;
+}
+
+/* Removes page P's mapping of FP, if it has one, and writes FP
+   back to its file if it has been modified. */
+void
+pagecache_unmap (struct file_page *fp, struct page *p)
+{
+  lock_acquire (&fp->lock);
+  remove_mapping (fp, p);
+  if (fp->frame != NULL)
+    write_back (fp);
+  lock_release (&fp->lock);
+}
+
+/* Copies FP's contents into KPAGE and removes page P's mapping of
+   FP, if it has one, so that P can be given a private copy.
+   Returns false if FP cannot be brought into memory. */
+bool
+pagecache_copy (struct file_page *fp, struct page *p, void *kpage)
+{
+  bool success;
+
+  lock_acquire (&fp->lock);
+  success = load (fp);
+  if (success)
+    {
+      memcpy (kpage, fp->frame->kpage, PGSIZE);
+      remove_mapping (fp, p);
+    }
+  lock_release (&fp->lock);
+  return success;
+}
+
+/* Returns true if any process has accessed FP since the last
+   call, and clears the accessed bits.  FP's lock must be held. */
+bool
+pagecache_accessed (struct file_page *fp)
+{
+  struct list_elem *e;
+  bool accessed = false;
+
+  ASSERT (lock_held_by_current_thread (&fp->lock));
+
+  for (e = list_begin (&fp->mappers); e != list_end (&fp->mappers);
+       e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, mapper_elem);
+      uint32_t *pd = p->owner->pagedir;
+
+      if (pagedir_is_accessed (pd, p->upage))
+        {
+          pagedir_set_accessed (pd, p->upage, false);
+          accessed = true;
+        }
+    }
+  return accessed;
+}
+
+/* Unmaps FP from every process that maps it and writes it back
+   to its file if it has been modified, or to swap if it is
+   anonymous, so that its frame can be reused.  FP's lock must be
+   held.  Returns true if successful, false, leaving FP mapped,
+   if FP is anonymous and no swap slot is free. */
+bool
+pagecache_out (struct file_page *fp)
+{
+  ASSERT (lock_held_by_current_thread (&fp->lock));
+  ASSERT (fp->frame != NULL);
+
+  /* Anonymous pages are only mapped read-only, so they cannot
+     change while they are written to swap. */
+  if (fp->inode == NULL)
+    {
+      fp->swap_slot = swap_out (fp->frame->kpage);
+      if (fp->swap_slot == SWAP_NONE)
+        return false;
+    }
+
+  while (!list_empty (&fp->mappers))
+    {
+      struct page *p = list_entry (list_pop_front (&fp->mappers),
+                                   struct page, mapper_elem);
+      uint32_t *pd = p->owner->pagedir;
+
+      /* The PTE keeps its dirty bit after it is cleared. */
+      pagedir_clear_page (pd, p->upage);
+      if (pagedir_is_dirty (pd, p->upage))
+        fp->dirty = true;
+    }
+  write_back (fp);
+  fp->frame = NULL;
+  return true;
+}
+
+/* Prints page cache statistics. */
+void
+pagecache_print_stats (void)
+{
+  printf ("Page cache: %lld pages mapped, %lld already in memory (%lld%%)\n",
+          map_cnt, shared_cnt, map_cnt > 0 ? shared_cnt * 100 / map_cnt : 0);
+}
+
+/* Returns a new file_page, with no references, for the page of
+   INODE at offset OFS, or for an anonymous page if INODE is
+   null.  Returns a null pointer if memory allocation fails. */
+static struct file_page *
+file_page_create (struct inode *inode, off_t ofs, size_t read_bytes)
+{
+  struct file_page *fp = malloc (sizeof *fp);
+
+  if (fp == NULL)
+    {
+      inode_close (inode);
+      return NULL;
+    }
+  fp->inode = inode;
+  fp->ofs = ofs;
+  fp->read_bytes = read_bytes;
+  fp->text = false;
+  fp->ref_cnt = 0;
+  lock_init (&fp->lock);
+  fp->frame = NULL;
+  list_init (&fp->mappers);
+  fp->dirty = false;
+  fp->swap_slot = SWAP_NONE;
+  return fp;
+}
+
+/* Brings FP into a frame if it is not already in one, reading it
+   from its file or from swap.  FP's lock must be held.  Returns
+   true if successful, false if no frame is available. */
+static bool
+load (struct file_page *fp)
+{
+  struct frame *f;
+
+  if (fp->frame != NULL)
+    return true;
+
+  f = frame_alloc_shared (fp);
+  if (f == NULL)
+    return false;
+  if (fp->inode == NULL)
+    {
+      swap_in (fp->swap_slot, f->kpage);
+      fp->swap_slot = SWAP_NONE;
+    }
+  else
+    {
+      if (inode_read_at (fp->inode, f->kpage, fp->read_bytes, fp->ofs)
+          != (off_t) fp->read_bytes)
+        {
+          frame_free (f);
+          return false;
+        }
+      memset ((uint8_t *) f->kpage + fp->read_bytes, 0,
+              PGSIZE - fp->read_bytes);
+    }
+  fp->frame = f;
+  fp->dirty = false;
+  frame_unpin (f);
+  return true;
+}
+
+/* Removes page P's mapping of FP, if it has one.  FP's lock must
+   be held. */
+static void
+remove_mapping (struct file_page *fp, struct page *p)
+{
+  uint32_t *pd = p->owner->pagedir;
+
+  if (pagedir_get_page (pd, p->upage) != NULL)
+    {
+      pagedir_clear_page (pd, p->upage);
+      if (pagedir_is_dirty (pd, p->upage))
+        fp->dirty = true;
+      list_remove (&p->mapper_elem);
+    }
+}
+
+/* Writes FP's frame back to its file if it has been modified
+   through any mapping that is still present.  FP's lock must be
+   held and FP must be in a frame.  Only the bytes that were read
+   from the file are written, so the file does not grow.  Does
+   nothing for anonymous pages. */
+static void
+write_back (struct file_page *fp)
+{
+  struct list_elem *e;
+
+  if (fp->inode == NULL)
+    return;
+
+  for (e = list_begin (&fp->mappers); e != list_end (&fp->mappers);
+       e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, mapper_elem);
+      uint32_t *pd = p->owner->pagedir;
+
+      if (pagedir_is_dirty (pd, p->upage))
+        {
+          pagedir_set_dirty (pd, p->upage, false);
+          fp->dirty = true;
+        }
+    }
+
+  if (fp->dirty)
+    {
+      inode_write_at (fp->inode, fp->frame->kpage, fp->read_bytes, fp->ofs);
+      fp->dirty = false;
+    }
+}
+
+/* Returns a hash value for the file page that E refers to. */
+static unsigned
+file_page_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct file_page *fp = hash_entry (e, struct file_page, hash_elem);
+  return hash_bytes (&fp->inode, sizeof fp->inode) ^ hash_int (fp->ofs);
+}
+
+/* Returns true if file page A precedes file page B. */
+static bool
+file_page_less (const struct hash_elem *a_, const struct hash_elem *b_,
+                void *aux UNUSED)
+{
+  const struct file_page *a = hash_entry (a_, struct file_page, hash_elem);
+  const struct file_page *b = hash_entry (b_, struct file_page, hash_elem);
+
+  if (a->inode != b->inode)
+    return a->inode < b->inode;
+  if (a->ofs != b->ofs)
+    return a->ofs < b->ofs;
+  if (a->read_bytes != b->read_bytes)
+    return a->read_bytes < b->read_bytes;
+  return a->text < b->text;
+}
@@ -0,0 +1,56 @@
+#ifndef VM_PAGECACHE_H
+#define VM_PAGECACHE_H
+
+#include <hash.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "filesys/off_t.h"
+#include "threads/synch.h"
+
+struct inode;
+struct page;
+
+/* A page of a file that is mapped into memory.
+
+   There is at most one file_page for each page of a file, so
+   every process that maps the page shares the frame that holds
+   it.  The read-only text pages of running executables form a
+   separate set, so that mmap() cannot write to them.  Changes are written back to the file when they are
+   unmapped and when the frame is evicted.
+
+   A file_page without an inode is instead an anonymous page that
+   fork() left shared between processes.  It is mapped read-only
+   and copied when a process writes to it, is not in the page
+   cache's index, and goes to swap when evicted. */
+struct file_page
+  {
+    struct hash_elem hash_elem;         /* Element in the page cache. */
+    struct inode *inode;                /* File, or null if anonymous. */
+    off_t ofs;                          /* Offset in INODE. */
+    size_t read_bytes;                  /* Bytes of file, rest zeroed. */
+    bool text;                          /* Executable's read-only page? */
+    int ref_cnt;                        /* Protected by the cache lock. */
+
+    struct lock lock;                   /* Protects the members below. */
+    struct frame *frame;                /* Frame, if in memory. */
+    struct list mappers;                /* Pages that map FRAME. */
+    bool dirty;                         /* FRAME modified since read? */
+    size_t swap_slot;                   /* Anonymous: swap slot, if any. */
+  };
+
+void pagecache_init (void);
+struct file_page *pagecache_get (struct inode *, off_t ofs,
+                                 size_t read_bytes, bool text);
+void pagecache_ref (struct file_page *);
+void pagecache_put (struct file_page *);
+bool pagecache_share (struct page *);
+
+bool pagecache_map (struct file_page *, struct page *);
+void pagecache_unmap (struct file_page *, struct page *);
+bool pagecache_copy (struct file_page *, struct page *, void *kpage);
+bool pagecache_accessed (struct file_page *);
+bool pagecache_out (struct file_page *);
+void pagecache_print_stats (void);
+
+#endif /* vm/pagecache.h */
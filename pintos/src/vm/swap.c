@@ -0,0 +1,110 @@
+#include "vm/swap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <stdio.h>
+#include "devices/block.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Number of sectors in a swap slot, which holds one page. */
+#define SLOT_SECTORS (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* The swap device, or a null pointer if there is none. */
+static struct block *swap_device;
+
+/* Swap slots in use.  A null pointer if there is no swap
+   device. */
+static struct bitmap *used_slots;
+static struct lock swap_lock;           /* Protects used_slots. */
+
+/* Statistics. */
+static long long swap_in_cnt;           /* Pages read from swap. */
+static long long swap_out_cnt;          /* Pages written to swap. */
+
+static void slot_buffers (void *kpage, void *buffers[SLOT_SECTORS]);
+
+/* Initializes swap on the block device in the BLOCK_SWAP role.
+   Without one, pages that have to be swapped out stay in
+   memory. */
+void
+swap_init (void)
+{
+  lock_init (&swap_lock);
+  swap_device = block_get_role (BLOCK_SWAP);
+  if (swap_device == NULL)
+    return;
+
+  used_slots = bitmap_create (block_size (swap_device) / SLOT_SECTORS);
+  if (used_slots == NULL)
+    PANIC ("bitmap creation failed--swap device is too large");
+}
+
+/* Writes the page at KPAGE to a free swap slot and returns the
+   slot's index, or SWAP_NONE if swap is full or missing. */
+size_t
+swap_out (const void *kpage)
+{
+  void *buffers[SLOT_SECTORS];
+  size_t slot;
+
+  if (used_slots == NULL)
+    return SWAP_NONE;
+
+  lock_acquire (&swap_lock);
+  slot = bitmap_scan_and_flip (used_slots, 0, 1, false);
+  lock_release (&swap_lock);
+  if (slot == BITMAP_ERROR)
+    return SWAP_NONE;
+
+  slot_buffers ((void *) kpage, buffers);
+  block_write_multiple (swap_device, slot * SLOT_SECTORS, SLOT_SECTORS,
+                        (const void **) buffers);
+  swap_out_cnt++;
+  return slot;
+}
+
+/* Reads the page in swap slot SLOT into KPAGE and frees the
+   slot. */
+void
+swap_in (size_t slot, void *kpage)
+{
+  void *buffers[SLOT_SECTORS];
+
+  ASSERT (slot != SWAP_NONE);
+
+  slot_buffers (kpage, buffers);
+  block_read_multiple (swap_device, slot * SLOT_SECTORS, SLOT_SECTORS,
+                       buffers);
+  swap_in_cnt++;
+  swap_free (slot);
+}
+
+/* Frees swap slot SLOT without reading it. */
+void
+swap_free (size_t slot)
+{
+  ASSERT (slot != SWAP_NONE);
+
+  lock_acquire (&swap_lock);
+  ASSERT (bitmap_test (used_slots, slot));
+  bitmap_reset (used_slots, slot);
+  lock_release (&swap_lock);
+}
+
+/* Prints swap statistics. */
+void
+swap_print_stats (void)
+{
+  printf ("Swap: %lld pages in, %lld pages out\n",
+          swap_in_cnt, swap_out_cnt);
+}
+
+/* Fills BUFFERS with pointers to the sectors of KPAGE. */
+static void
+slot_buffers (void *kpage, void *buffers[SLOT_SECTORS])
+{
+  size_t i;
+
+  for (i = 0; i < SLOT_SECTORS; i++)
+    buffers[i] = (uint8_t *) kpage + i * BLOCK_SECTOR_SIZE;
+}